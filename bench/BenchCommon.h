@@ -0,0 +1,67 @@
+#pragma once
+// Helpers shared by the benchmark programs
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <nlohmann/json.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace bench {
+
+// Peak resident memory of this process in KiB
+inline long selfPeakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return (long)(pmc.PeakWorkingSetSize / 1024);
+    return 0;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024; // bytes on macOS
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+inline std::string compilerName() {
+#if defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+    return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string("gcc ") + __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+
+// "build" object of a report, so reports of two builds can be told apart
+inline nlohmann::json buildInfo() {
+    return { {"compiler", compilerName()}, {"build_type", MODYPLUS_BUILD_TYPE} };
+}
+
+// The engine and the media manager log every step; swallow std::cout while measuring
+class QuietCout {
+public:
+    explicit QuietCout(bool quiet) : saved_(std::cout.rdbuf()) {
+        if (quiet) std::cout.rdbuf(sink_.rdbuf());
+    }
+    ~QuietCout() { std::cout.rdbuf(saved_); }
+    QuietCout(const QuietCout &) = delete;
+    QuietCout &operator=(const QuietCout &) = delete;
+
+private:
+    std::streambuf *saved_;
+    std::ostringstream sink_;
+};
+
+} // namespace bench
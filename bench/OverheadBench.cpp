@@ -0,0 +1,349 @@
+// Orchestration-overhead benchmark: everything the orchestrator spends outside ffmpeg. Uses the
+// stub ffmpeg/ffprobe built next to it (bench/stub), so there is no encode noise.
+//
+//   modyplus_overhead_bench [--stub PATH] [--entries N,M,...] [--scan-files N] [--ops N]
+//                           [--iterations N] [--workdir DIR] [--report FILE] [--verbose]
+//
+// The workdir and report default to the build directory.
+//
+// Cases: media index load / rescan / save (JSON and binary) with N entries, a cold scanAssets
+// probing every file with the stub ffprobe, FFmpegCommandBuilder string construction, thread
+// pool dispatch throughput and latency, and scheduling of large rule files (dry run, run with
+// the stub, run again with every op cached).
+
+#include "RemixRuleEngine.h"
+#include "MediaManager.h"
+#include "MediaIndexFile.h"
+#include "FFmpegCommandBuilder.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "Utils.h"
+#include "BenchCommon.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+double timeIt(F &&f) {
+    auto start = Clock::now();
+    f();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+json caseJson(const std::string &name, size_t count, double seconds) {
+    return { {"name", name}, {"count", count}, {"seconds", seconds},
+             {"per_item_us", count > 0 ? seconds * 1e6 / (double)count : 0.0} };
+}
+
+void printCase(const json &c) {
+    std::cout << c["name"].get<std::string>() << ": " << c["count"].get<size_t>() << " in " << c["seconds"].get<double>()
+              << " s (" << c["per_item_us"].get<double>() << " us each)" << std::endl;
+}
+
+// n tiny files spread over folders of 1000, like a large asset library; returns their paths
+// in the exact spelling the scanner's directory walk produces
+std::vector<std::string> makeAssetTree(const fs::path &dir, size_t n) {
+    fs::remove_all(dir);
+    for (size_t i = 0; i < n; ++i) {
+        fs::path sub = dir / ("set_" + std::to_string(i / 1000));
+        if (i % 1000 == 0) fs::create_directories(sub);
+        std::ofstream(sub / ("clip_" + std::to_string(i) + ".mp4")) << "x";
+    }
+    std::vector<std::string> paths;
+    for (auto &it : fs::recursive_directory_iterator(dir)) {
+        if (it.is_regular_file()) paths.push_back(it.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Index load, unchanged rescan and snapshot write for n entries, binary and JSON. The
+// binary index is written directly; the JSON one is exported from it, so both hold the
+// same entries with fingerprints matching the files (every rescan lookup is a hit).
+void indexCases(const std::string &stub, const fs::path &root, size_t n, json &results) {
+    fs::path assets = root / ("index_assets_" + std::to_string(n));
+    std::vector<std::string> paths = makeAssetTree(assets, n);
+    std::vector<MediaEntry> entries(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        MediaEntry &e = entries[i];
+        e.path = paths[i];
+        e.fingerprint = util::fileFingerprint(paths[i]);
+        e.type = MediaType::Video;
+        e.duration = 10.0;
+        e.width = 1280;
+        e.height = 720;
+        e.fps = 30.0f;
+        e.sampleRate = 44100;
+        e.videoCodec = internMediaName("h264");
+        e.audioCodec = internMediaName("aac");
+        e.pixelFormat = internMediaName("yuv420p");
+    }
+    std::string suffix = "_" + std::to_string(n);
+
+    for (const std::string format : { "binary", "json" }) {
+        fs::path dir = root / ("index_" + format + suffix);
+        if (format == "binary") {
+            fs::remove_all(dir);
+            fs::create_directories(dir);
+            writeMediaIndexFile((dir / "media_index.bin").string(), entries, std::vector<std::string>(entries.size()));
+        }
+        std::unique_ptr<MediaManager> mm;
+        double load = timeIt([&]() { mm.reset(new MediaManager(stub, dir.string(), format)); });
+        double scan = timeIt([&]() { mm->scanAssets(assets.string(), 0); });
+        double save = timeIt([&]() { mm->saveIndex(); });
+        if (format == "binary") {
+            fs::path jsonDir = root / ("index_json" + suffix);
+            fs::remove_all(jsonDir);
+            fs::create_directories(jsonDir);
+            mm->exportIndexJson((jsonDir / "media_index.json").string());
+        }
+        mm.reset();
+        results.push_back(caseJson("index_load_" + format + suffix, n, load));
+        results.push_back(caseJson("rescan_unchanged_" + format + suffix, n, scan));
+        results.push_back(caseJson("index_save_" + format + suffix, n, save));
+    }
+}
+
+json coldScanCase(const std::string &stub, const fs::path &root, size_t n) {
+    fs::path assets = root / "scan_assets";
+    makeAssetTree(assets, n);
+    fs::path dir = root / "scan_cold";
+    fs::remove_all(dir);
+    Trace::clear();
+    double seconds = timeIt([&]() {
+        MediaManager mm(stub, dir.string());
+        mm.scanAssets(assets.string(), 0);
+    });
+    json c = caseJson("scan_cold_stub_ffprobe", n, seconds);
+    c["process_launches"] = Trace::totals().children;
+    return c;
+}
+
+json builderCase(size_t iterations) {
+    std::vector<std::pair<double, double>> ranges = { {1.0, 1.5}, {3.0, 3.25}, {7.5, 8.0} };
+    size_t bytes = 0;
+    double seconds = timeIt([&]() {
+        for (size_t i = 0; i < iterations; ++i) {
+            double t = (double)(i % 97) * 0.1;
+            switch (i % 7) {
+            case 0: bytes += FFmpegCommandBuilder::stutterInPlaceCmd("ffmpeg", "assets/clip one.mp4", t, 0.25, 8, true, "output/s.mp4").size(); break;
+            case 1: bytes += FFmpegCommandBuilder::overlayCmd("ffmpeg", "assets/a.mp4", "assets/logo.gif", t, t + 2.0, 0.2, "topright", "output/o.mp4").size(); break;
+            case 2: bytes += FFmpegCommandBuilder::pitchShiftCmd("ffmpeg", "assets/a.mp4", 3.0, "output/p.mp4").size(); break;
+            case 3: bytes += FFmpegCommandBuilder::randomChopExtractCmd("ffmpeg", "assets/a.mp4", (int)i, t, 0.3, "output/frag.mp4").size(); break;
+            case 4: bytes += FFmpegCommandBuilder::bleepCensorCmd("ffmpeg", "assets/a.mp4", ranges, "output/b.mp4").size(); break;
+            case 5: bytes += FFmpegCommandBuilder::extractFragmentCmd("ffmpeg", "assets/a.mp4", t, 0.5, "output/x.mp4").size(); break;
+            default: bytes += FFmpegCommandBuilder::stutterLoopCmd("ffmpeg", "assets/a.mp4", t, 0.25, 8, true, "output/l.mp4").size(); break;
+            }
+        }
+    });
+    json c = caseJson("command_builder", iterations, seconds);
+    c["bytes"] = bytes; // keeps the work observable
+    return c;
+}
+
+void poolCases(size_t iterations, json &results) {
+    size_t workers = std::max(2u, std::thread::hardware_concurrency());
+
+    // throughput: many empty tasks from one producer
+    {
+        util::ThreadPool pool(workers);
+        std::atomic<size_t> done{0};
+        double seconds = timeIt([&]() {
+            for (size_t i = 0; i < iterations; ++i) pool.enqueue([&done]() { ++done; });
+            pool.waitAll();
+        });
+        results.push_back(caseJson("pool_dispatch_throughput", iterations, seconds));
+    }
+
+    // latency: enqueue-to-start of one task at a time on an idle pool
+    {
+        util::ThreadPool pool(workers);
+        size_t rounds = std::max<size_t>(1, iterations / 50);
+        std::vector<double> latencies;
+        latencies.reserve(rounds);
+        double seconds = timeIt([&]() {
+            for (size_t i = 0; i < rounds; ++i) {
+                auto queued = Clock::now();
+                auto started = pool.submit([]() { return Clock::now(); }).get();
+                latencies.push_back(std::chrono::duration<double, std::micro>(started - queued).count());
+            }
+        });
+        std::sort(latencies.begin(), latencies.end());
+        json c = caseJson("pool_dispatch_latency", rounds, seconds);
+        c["median_us"] = latencies[latencies.size() / 2];
+        c["p99_us"] = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        results.push_back(c);
+    }
+
+    // task groups: fan out from a worker and wait there, as the engine does
+    {
+        util::ThreadPool pool(workers);
+        std::atomic<size_t> done{0};
+        size_t fanout = 100;
+        size_t groups = std::max<size_t>(1, iterations / fanout);
+        double seconds = timeIt([&]() {
+            util::TaskGroup outer(pool);
+            for (size_t g = 0; g < groups; ++g) {
+                outer.run([&pool, &done, fanout]() {
+                    util::TaskGroup inner(pool);
+                    for (size_t i = 0; i < fanout; ++i) inner.run([&done]() { ++done; });
+                    inner.wait();
+                });
+            }
+            outer.wait();
+        });
+        results.push_back(caseJson("task_group_fanout", groups * fanout, seconds));
+    }
+}
+
+// Rules with `count` ops in chains of ten (each op reads the previous one's output), so the
+// DAG has real dependencies, cycling through the op types that take one input
+std::string writeScheduleRules(const fs::path &dir, size_t count) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string source = (dir / "source.mp4").string();
+    std::string logo = (dir / "logo.mp4").string();
+    std::ofstream(source) << "x";
+    std::ofstream(logo) << "x";
+    json ops = json::array();
+    std::string prev;
+    for (size_t i = 0; i < count; ++i) {
+        std::string in = i % 10 == 0 ? source : prev;
+        std::string out = (dir / ("op_" + std::to_string(i) + ".mp4")).string();
+        json op;
+        switch (i % 4) {
+        case 0: op = { {"type", "pitch"}, {"input", in}, {"semitones", 2} }; break;
+        case 1: op = { {"type", "overlay"}, {"input", in}, {"overlay", logo}, {"start", 1.0}, {"end", 3.0} }; break;
+        case 2: op = { {"type", "bleep"}, {"input", in}, {"ranges", { { {"start", 1.0}, {"end", 1.5} } }} }; break;
+        default: op = { {"type", "stutter"}, {"input", in}, {"start", 2.0}, {"duration", 0.25}, {"repeats", 4} }; break;
+        }
+        op["output"] = out;
+        ops.push_back(op);
+        prev = out;
+    }
+    json rules = { {"global", { {"workdir", dir.string()} }}, {"operations", ops} };
+    std::string path = (dir / "rules.json").string();
+    std::ofstream(path) << rules.dump();
+    return path;
+}
+
+void scheduleCases(const std::string &stub, const fs::path &root, size_t count, json &results) {
+    fs::path dir = root / "schedule";
+    std::string rules = writeScheduleRules(dir, count);
+    struct Run { const char *name; bool dryRun; bool cache; };
+    // the cached run follows the cold one, so every op is a hit
+    for (const Run &run : { Run{ "schedule_dry_run", true, false }, Run{ "schedule_exec_stub", false, true },
+                            Run{ "schedule_all_cached", false, true } }) {
+        RemixRuleEngine engine(stub, dir.string());
+        engine.setCacheEnabled(run.cache);
+        Trace::clear();
+        int rc = 0;
+        double seconds = timeIt([&]() { rc = engine.runFromJson(rules, run.dryRun); });
+        json c = caseJson(run.name, count, seconds);
+        c["process_launches"] = Trace::totals().children;
+        c["ok"] = rc == 0;
+        results.push_back(c);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string stub = MODYPLUS_STUB_FFMPEG;
+    std::vector<size_t> entryCounts = { 10000, 100000 };
+    size_t scanFiles = 2000;
+    size_t opCount = 1000;
+    size_t iterations = 200000;
+    // generated data (100k-entry indexes, thousands of stub clips) stays out of the source tree
+    fs::path buildDir = MODYPLUS_BENCH_DIR;
+    std::string workdir = (buildDir / "bench_overhead_work").string();
+    std::string reportPath = (buildDir / "bench_overhead_report.json").string();
+    bool verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (opt == "--stub" && hasValue) stub = argv[++i];
+        else if (opt == "--scan-files" && hasValue) scanFiles = (size_t)std::max(1, std::atoi(argv[++i]));
+        else if (opt == "--ops" && hasValue) opCount = (size_t)std::max(1, std::atoi(argv[++i]));
+        else if (opt == "--iterations" && hasValue) iterations = (size_t)std::max(100, std::atoi(argv[++i]));
+        else if (opt == "--workdir" && hasValue) workdir = argv[++i];
+        else if (opt == "--report" && hasValue) reportPath = argv[++i];
+        else if (opt == "--entries" && hasValue) {
+            entryCounts.clear();
+            std::stringstream list(argv[++i]);
+            std::string n;
+            while (std::getline(list, n, ',')) if (std::atoi(n.c_str()) > 0) entryCounts.push_back((size_t)std::atoi(n.c_str()));
+        } else if (opt == "--verbose") verbose = true;
+        else std::cerr << "Ignoring unknown option: " << opt << std::endl;
+    }
+    if (!fs::exists(stub)) {
+        std::cerr << "Stub ffmpeg not found: " << stub << " (pass --stub)\n";
+        return 1;
+    }
+
+    fs::path root = fs::absolute(workdir);
+    fs::create_directories(root);
+    Trace::enable(); // counts process launches
+    json results = json::array();
+    auto record = [&](const json &c) {
+        printCase(c);
+        results.push_back(c);
+    };
+
+    for (size_t n : entryCounts) {
+        json cases = json::array();
+        {
+            bench::QuietCout quiet(!verbose);
+            indexCases(stub, root, n, cases);
+        }
+        for (auto &c : cases) record(c);
+    }
+    {
+        json c;
+        {
+            bench::QuietCout quiet(!verbose);
+            c = coldScanCase(stub, root, scanFiles);
+        }
+        record(c);
+    }
+    record(builderCase(iterations));
+    {
+        json cases = json::array();
+        poolCases(iterations, cases);
+        for (auto &c : cases) record(c);
+    }
+    {
+        json cases = json::array();
+        {
+            bench::QuietCout quiet(!verbose);
+            scheduleCases(stub, root, opCount, cases);
+        }
+        for (auto &c : cases) record(c);
+    }
+
+    json report = {
+        {"benchmark", "modyplus_overhead"},
+        {"build", bench::buildInfo()},
+        {"threads", std::thread::hardware_concurrency()},
+        {"bench_peak_rss_mb", bench::selfPeakRssKb() / 1024.0},
+        {"cases", results}
+    };
+    std::ofstream ofs(reportPath);
+    ofs << report.dump(2) << "\n";
+    std::cout << "Report written to " << reportPath << std::endl;
+    bool ok = std::all_of(results.begin(), results.end(), [](const json &c) { return c.value("ok", true); });
+    return ok ? 0 : 3;
+}
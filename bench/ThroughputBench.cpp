@@ -0,0 +1,270 @@
+// End-to-end throughput benchmark: generates synthetic media with ffmpeg's lavfi sources,
+// runs every operation type and a full normalization pass through the real engine, and
+// reports media seconds per wall second, child process launches and peak memory as JSON.
+//
+//   modyplus_bench <path-to-ffmpeg> [--scale S] [--repeat N] [--cases a,b,...]
+//                  [--workdir DIR] [--report FILE] [--verbose]
+//
+// The workdir and report default to the build directory.
+
+#include "RemixRuleEngine.h"
+#include "MediaManager.h"
+#include "ResourceCoordinator.h"
+#include "Process.h"
+#include "Trace.h"
+#include "Utils.h"
+#include "BenchCommon.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Clip {
+    std::string name;
+    int width;
+    int height;
+    double seconds;
+    std::string path;
+};
+
+struct CaseResult {
+    double wallSeconds = 0.0;
+    double mediaSeconds = 0.0;
+    Trace::Totals children;
+    bool ok = true;
+};
+
+const char *kOperationCases[] = { "stutter", "overlay", "pitch", "random_chop", "concat", "bleep" };
+
+std::string firstLine(const std::string &text) {
+    return text.substr(0, text.find_first_of("\r\n"));
+}
+
+double mediaDuration(const std::string &ffprobe, const std::string &path) {
+    util::ProcessOptions opts;
+    opts.captureStdout = true;
+    auto pr = util::runProcess({ ffprobe, "-v", "error", "-show_entries", "format=duration",
+                                 "-of", "default=noprint_wrappers=1:nokey=1", path }, opts);
+    try {
+        return pr.exitCode == 0 ? std::stod(pr.out) : 0.0;
+    } catch (...) {
+        return 0.0;
+    }
+}
+
+// testsrc2 video with a sine tone, encoded once up front; not part of any measurement
+bool generateClip(const std::string &ffmpeg, const Clip &c) {
+    std::ostringstream src, tone;
+    src << "testsrc2=size=" << c.width << "x" << c.height << ":rate=30:duration=" << c.seconds;
+    tone << "sine=frequency=440:sample_rate=44100:duration=" << c.seconds;
+    util::ProcessOptions opts;
+    opts.captureStderr = true;
+    auto pr = util::runProcess({ ffmpeg, "-y", "-v", "error", "-f", "lavfi", "-i", src.str(), "-f", "lavfi", "-i", tone.str(),
+                                 "-c:v", "libx264", "-preset", "veryfast", "-pix_fmt", "yuv420p", "-c:a", "aac",
+                                 "-shortest", c.path }, opts);
+    if (pr.exitCode != 0) std::cerr << "Failed to generate " << c.path << ": " << firstLine(pr.err) << std::endl;
+    return pr.exitCode == 0;
+}
+
+json operationSpec(const std::string &type, const Clip &clip, const Clip &overlay, const std::string &output) {
+    double len = clip.seconds;
+    if (type == "stutter") {
+        return { {"type", type}, {"input", clip.path}, {"start", len * 0.25}, {"duration", 0.25}, {"repeats", 6},
+                 {"in_place", true}, {"output", output} };
+    } else if (type == "overlay") {
+        return { {"type", type}, {"input", clip.path}, {"overlay", overlay.path}, {"start", 0.0}, {"end", len},
+                 {"overlay_scale", 0.25}, {"position", "topright"}, {"output", output} };
+    } else if (type == "pitch") {
+        return { {"type", type}, {"input", clip.path}, {"semitones", 3}, {"output", output} };
+    } else if (type == "random_chop") {
+        return { {"type", type}, {"input", clip.path}, {"count", 12}, {"min_len", 0.1}, {"max_len", 0.5}, {"seed", 7},
+                 {"output", output} };
+    } else if (type == "concat") {
+        return { {"type", type}, {"inputs", { clip.path, clip.path }}, {"output", output} };
+    }
+    // bleep
+    json ranges = json::array();
+    for (double t = 0.5; t + 0.3 < len; t += 1.5) ranges.push_back({ {"start", t}, {"end", t + 0.3} });
+    return { {"type", "bleep"}, {"input", clip.path}, {"ranges", ranges}, {"output", output} };
+}
+
+// Rules running `type` on every clip, `copies` times each, so independent ops overlap
+// as they would in a real rule file
+CaseResult runOperationCase(const std::string &ffmpeg, const std::string &type, const std::vector<Clip> &clips,
+                            const Clip &overlay, int copies, const fs::path &dir, ResourceCoordinator &coordinator) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    json rules;
+    rules["global"] = { {"workdir", dir.string()} };
+    rules["operations"] = json::array();
+    std::vector<std::string> outputs;
+    for (const Clip &clip : clips) {
+        for (int k = 0; k < copies; ++k) {
+            std::string out = (dir / (type + "_" + clip.name + "_" + std::to_string(k) + ".mp4")).string();
+            rules["operations"].push_back(operationSpec(type, clip, overlay, out));
+            outputs.push_back(out);
+        }
+    }
+    std::string rulesPath = (dir / "rules.json").string();
+    std::ofstream(rulesPath) << rules.dump(2);
+
+    CaseResult r;
+    Trace::clear();
+    RemixRuleEngine engine(ffmpeg, dir.string());
+    engine.setCacheEnabled(false);
+    engine.setCoordinator(&coordinator);
+    auto start = std::chrono::steady_clock::now();
+    int rc = engine.runFromJson(rulesPath, false);
+    r.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.children = Trace::totals();
+    r.ok = rc == 0;
+    std::string ffprobe = util::toolPath(ffmpeg, "ffprobe");
+    for (auto &out : outputs) r.mediaSeconds += mediaDuration(ffprobe, out);
+    return r;
+}
+
+// scanAssets + normalizeAll over the generated clips in a fresh workdir
+CaseResult runNormalizeCase(const std::string &ffmpeg, const fs::path &assets, const std::vector<Clip> &clips,
+                            const fs::path &dir, ResourceCoordinator &coordinator) {
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    CaseResult r;
+    Trace::clear();
+    auto start = std::chrono::steady_clock::now();
+    MediaManager mm(ffmpeg, dir.string());
+    mm.setCoordinator(&coordinator);
+    mm.scanAssets(assets.string(), 0);
+    r.ok = mm.normalizeAll(coordinator.maxJobs(), 1280, 720, 30.0);
+    r.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.children = Trace::totals();
+    for (const Clip &c : clips) r.mediaSeconds += c.seconds;
+    return r;
+}
+
+json resultJson(const std::string &name, const std::vector<CaseResult> &runs) {
+    // report the fastest run; the rest are usually warm-up noise
+    const CaseResult &best = *std::min_element(runs.begin(), runs.end(),
+        [](const CaseResult &a, const CaseResult &b) { return a.wallSeconds < b.wallSeconds; });
+    json walls = json::array();
+    for (auto &r : runs) walls.push_back(r.wallSeconds);
+    bool ok = std::all_of(runs.begin(), runs.end(), [](const CaseResult &r) { return r.ok; });
+    return {
+        {"name", name},
+        {"ok", ok},
+        {"wall_seconds", best.wallSeconds},
+        {"all_wall_seconds", walls},
+        {"media_seconds", best.mediaSeconds},
+        {"media_seconds_per_second", best.wallSeconds > 0.0 ? best.mediaSeconds / best.wallSeconds : 0.0},
+        {"process_launches", best.children.children},
+        {"child_cpu_seconds", best.children.userSeconds + best.children.systemSeconds},
+        {"child_peak_rss_mb", best.children.peakRssKb / 1024.0},
+        {"child_read_mb", best.children.readBytes / (1024.0 * 1024.0)},
+        {"child_written_mb", best.children.writeBytes / (1024.0 * 1024.0)}
+    };
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: modyplus_bench <path-to-ffmpeg> [--scale S] [--repeat N] [--cases a,b,...] "
+                     "[--workdir DIR] [--report FILE] [--verbose]\n";
+        return 1;
+    }
+    std::string ffmpeg = argv[1];
+    double scale = 1.0;
+    int repeat = 1;
+    fs::path buildDir = MODYPLUS_BENCH_DIR;
+    std::string workdir = (buildDir / "bench_work").string();
+    std::string reportPath = (buildDir / "bench_report.json").string();
+    std::vector<std::string> cases(std::begin(kOperationCases), std::end(kOperationCases));
+    cases.push_back("normalize");
+    bool verbose = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string opt = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (opt == "--scale" && hasValue) scale = std::max(0.1, std::atof(argv[++i]));
+        else if (opt == "--repeat" && hasValue) repeat = std::max(1, std::atoi(argv[++i]));
+        else if (opt == "--workdir" && hasValue) workdir = argv[++i];
+        else if (opt == "--report" && hasValue) reportPath = argv[++i];
+        else if (opt == "--cases" && hasValue) {
+            cases.clear();
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) if (!name.empty()) cases.push_back(name);
+        } else if (opt == "--verbose") verbose = true;
+        else std::cerr << "Ignoring unknown option: " << opt << std::endl;
+    }
+
+    // --scale stretches every clip and adds more operations per clip
+    double base = 4.0 * scale;
+    int copies = (int)std::ceil(scale);
+    fs::path root = fs::absolute(workdir);
+    fs::path assets = root / "assets";
+    fs::remove_all(assets);
+    fs::create_directories(assets);
+    std::vector<Clip> clips = {
+        { "360p", 640, 360, base, "" },
+        { "720p", 1280, 720, base * 2.0, "" },
+        { "1080p", 1920, 1080, base, "" },
+    };
+    Clip overlay{ "overlay", 320, 240, base * 2.0, "" };
+    std::cout << "Generating synthetic media (" << base << "-" << base * 2.0 << " s clips)..." << std::endl;
+    for (Clip *c : { &clips[0], &clips[1], &clips[2], &overlay }) {
+        c->path = (assets / (c->name + ".mp4")).string();
+        if (!generateClip(ffmpeg, *c)) return 2;
+    }
+
+    util::ProcessOptions versionOpts;
+    versionOpts.captureStdout = true;
+    std::string ffmpegVersion = firstLine(util::runProcess({ ffmpeg, "-version" }, versionOpts).out);
+
+    Trace::enable(); // child process accounting
+    ResourceCoordinator coordinator;
+    json results = json::array();
+    bool allOk = true;
+    for (const std::string &name : cases) {
+        bool known = name == "normalize" || std::find(std::begin(kOperationCases), std::end(kOperationCases), name) != std::end(kOperationCases);
+        if (!known) {
+            std::cerr << "Unknown case: " << name << " (skipping)\n";
+            continue;
+        }
+        std::vector<CaseResult> runs;
+        for (int k = 0; k < repeat; ++k) {
+            bench::QuietCout quiet(!verbose);
+            fs::path dir = root / ("case_" + name);
+            if (name == "normalize") runs.push_back(runNormalizeCase(ffmpeg, assets, clips, dir, coordinator));
+            else runs.push_back(runOperationCase(ffmpeg, name, clips, overlay, copies, dir, coordinator));
+        }
+        json r = resultJson(name, runs);
+        allOk = allOk && r["ok"].get<bool>();
+        std::cout << name << ": " << r["wall_seconds"].get<double>() << " s, " << r["media_seconds_per_second"].get<double>()
+                  << " media-s/s, " << r["process_launches"].get<size_t>() << " processes, child peak "
+                  << r["child_peak_rss_mb"].get<double>() << " MB" << (r["ok"].get<bool>() ? "" : " (FAILED)") << std::endl;
+        results.push_back(r);
+    }
+
+    json report = {
+        {"benchmark", "modyplus_throughput"},
+        {"scale", scale},
+        {"repeat", repeat},
+        {"build", bench::buildInfo()},
+        {"ffmpeg", ffmpegVersion},
+        {"machine", { {"cpu_threads", coordinator.threadBudget()}, {"memory_limit_mb", coordinator.memoryLimitMb()} }},
+        {"bench_peak_rss_mb", bench::selfPeakRssKb() / 1024.0},
+        {"cases", results}
+    };
+    std::ofstream ofs(reportPath);
+    ofs << report.dump(2) << "\n";
+    std::cout << "Report written to " << reportPath << std::endl;
+    return allOk ? 0 : 3;
+}
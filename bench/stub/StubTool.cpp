@@ -0,0 +1,85 @@
+// Stand-in for ffmpeg and ffprobe with no media work, for measuring the orchestrator's own
+// overhead. Built twice (as "ffmpeg" and "ffprobe" in one folder, so util::toolPath finds the
+// pair); the executable name picks the behaviour.
+//
+//   ffmpeg:  writes a few bytes to the output (last argument) and exits 0; answers -version and
+//            prints a finished report for -progress pipe:1
+//   ffprobe: prints canned answers shaped like the queries the orchestrator makes; fails like
+//            the real one when the input file does not exist
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *kDuration = "10.000000";
+
+int stubFFmpeg(const std::vector<std::string> &args) {
+    bool progress = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-version") {
+            std::printf("ffmpeg version stub (modyplus bench)\n");
+            return 0;
+        }
+        if (args[i] == "-progress") progress = true;
+    }
+    if (args.empty()) return 1;
+    const std::string &out = args.back();
+    if (out != "-" && out.compare(0, 5, "pipe:") != 0) {
+        FILE *f = std::fopen(out.c_str(), "wb");
+        if (!f) return 1;
+        std::fputs("stub\n", f);
+        std::fclose(f);
+    }
+    if (progress) std::printf("frame=300\nfps=1000.0\nspeed=33.3x\nprogress=end\n");
+    return 0;
+}
+
+int stubFFprobe(const std::vector<std::string> &args) {
+    if (args.empty()) return 1;
+    std::error_code ec;
+    if (!fs::exists(args.back(), ec)) return 1;
+
+    std::string entries;
+    std::string format;
+    bool streams = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-show_streams") streams = true;
+        if (i + 1 < args.size() && args[i] == "-show_entries") entries = args[i + 1];
+        if (i + 1 < args.size() && (args[i] == "-of" || args[i] == "-print_format")) format = args[i + 1];
+    }
+
+    if (entries.find("packet") != std::string::npos) {
+        // -show_entries packet=pts_time,flags -of csv=p=0: a keyframe every 2 s at 30 fps
+        for (int frame = 0; frame < 300; ++frame) std::printf("%.6f,%s\n", frame / 30.0, frame % 60 == 0 ? "K__" : "___");
+    } else if (streams) {
+        // full probe (MediaManager scans)
+        std::printf("{\"streams\":[{\"codec_type\":\"video\",\"codec_name\":\"h264\",\"width\":1280,\"height\":720,"
+                    "\"r_frame_rate\":\"30/1\",\"pix_fmt\":\"yuv420p\"},{\"codec_type\":\"audio\",\"codec_name\":\"aac\","
+                    "\"sample_rate\":\"44100\"}],\"format\":{\"duration\":\"%s\"}}\n", kDuration);
+    } else if (format == "json") {
+        // -select_streams v:0 -show_entries format=duration:stream=codec_name,width,height, and
+        // format=start_time:stream=codec_name,profile,level,pix_fmt,width,height for smart cuts
+        std::printf("{\"streams\":[{\"codec_name\":\"h264\",\"profile\":\"High\",\"level\":31,\"pix_fmt\":\"yuv420p\","
+                    "\"width\":1280,\"height\":720}],\"format\":{\"duration\":\"%s\",\"start_time\":\"0.000000\"}}\n", kDuration);
+    } else {
+        // default=noprint_wrappers=1:nokey=1: stream values first, then the format's
+        if (entries.find("codec_type") != std::string::npos) std::printf("video\naudio\n");
+        std::printf("%s\n", kDuration);
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string tool = fs::path(argv[0]).stem().string();
+    if (tool == "ffprobe") return stubFFprobe(args);
+    return stubFFmpeg(args);
+}
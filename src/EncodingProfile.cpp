@@ -0,0 +1,84 @@
+#include "EncodingProfile.h"
+#include <iostream>
+
+using json = nlohmann::json;
+
+std::string EncodingProfile::videoOptions() const {
+    std::string out = " -c:v " + videoCodec;
+    if (crf >= 0) out += " -crf " + std::to_string(crf);
+    if (qp >= 0) out += " -qp " + std::to_string(qp);
+    if (!preset.empty()) out += " -preset " + preset;
+    if (!pixFmt.empty()) out += " -pix_fmt " + pixFmt;
+    if (!videoArgs.empty()) out += " " + videoArgs;
+    return out;
+}
+
+std::string EncodingProfile::audioOptions() const {
+    std::string out = " -c:a " + audioCodec;
+    if (!audioBitrate.empty()) out += " -b:a " + audioBitrate;
+    return out;
+}
+
+EncodingProfile EncodingProfile::makeDelivery() {
+    return EncodingProfile();
+}
+
+EncodingProfile EncodingProfile::makeIntermediate() {
+    EncodingProfile p;
+    p.name = "intermediate";
+    p.preset = "ultrafast";
+    p.crf = -1;
+    p.qp = 0;
+    p.audioCodec = "alac";
+    p.audioBitrate.clear();
+    p.intermediate = true;
+    return p;
+}
+
+EncodingProfile EncodingProfile::makeDraft() {
+    EncodingProfile p;
+    p.name = "draft";
+    p.preset = "ultrafast";
+    p.crf = 28;
+    p.audioBitrate = "128k";
+    return p;
+}
+
+EncodingProfiles::EncodingProfiles() {
+    for (const EncodingProfile &p : { EncodingProfile::makeDelivery(), EncodingProfile::makeIntermediate(), EncodingProfile::makeDraft() }) {
+        profiles_[p.name] = p;
+    }
+}
+
+void EncodingProfiles::load(const json &profiles) {
+    if (!profiles.is_object()) return;
+    for (auto it = profiles.begin(); it != profiles.end(); ++it) {
+        const json &spec = it.value();
+        if (!spec.is_object()) continue;
+        EncodingProfile p = get(spec.value("base", "delivery"), "delivery");
+        p.name = it.key();
+        p.videoCodec = spec.value("video_codec", p.videoCodec);
+        p.preset = spec.value("preset", p.preset);
+        // crf and qp are alternative rate controls: setting one drops the base's other
+        if (spec.contains("crf")) { p.crf = spec["crf"].get<int>(); if (!spec.contains("qp")) p.qp = -1; }
+        if (spec.contains("qp")) { p.qp = spec["qp"].get<int>(); if (!spec.contains("crf")) p.crf = -1; }
+        p.pixFmt = spec.value("pix_fmt", p.pixFmt);
+        p.videoArgs = spec.value("video_args", p.videoArgs);
+        p.audioCodec = spec.value("audio_codec", p.audioCodec);
+        p.audioBitrate = spec.value("audio_bitrate", p.audioBitrate);
+        p.intermediate = spec.value("intermediate", p.intermediate);
+        profiles_[p.name] = p;
+    }
+}
+
+const EncodingProfile *EncodingProfiles::find(const std::string &name) const {
+    auto it = profiles_.find(name);
+    return it == profiles_.end() ? nullptr : &it->second;
+}
+
+const EncodingProfile &EncodingProfiles::get(const std::string &name, const std::string &fallback) const {
+    if (const EncodingProfile *p = find(name)) return *p;
+    std::cerr << "Unknown encoding profile '" << name << "', using '" << fallback << "'" << std::endl;
+    if (const EncodingProfile *p = find(fallback)) return *p;
+    return profiles_.at("delivery");
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <map>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Codec settings for one kind of output file. Files a later step reads again (intermediates)
+// get a cheap lossless profile; the delivery profile is applied once, by the step writing
+// the final output.
+struct EncodingProfile {
+    std::string name = "delivery";
+    std::string videoCodec = "libx264";
+    std::string preset = "veryfast";
+    int crf = 18;                      // < 0: not passed
+    int qp = -1;                       // < 0: not passed (libx264 -qp 0 is lossless)
+    std::string pixFmt;                // empty: keep the filter output's
+    std::string videoArgs;             // extra video options, e.g. "-g 1" for intra-only
+    std::string audioCodec = "aac";
+    std::string audioBitrate = "192k"; // empty: the codec's default (lossless codecs)
+    bool intermediate = false;         // stream-copying from such a file into a final output re-encodes instead
+
+    // " -c:v libx264 -crf 18 -preset veryfast" / " -c:a aac -b:a 192k"
+    std::string videoOptions() const;
+    std::string audioOptions() const;
+
+    // Built-ins: libx264 crf 18 + AAC 192k; libx264 ultrafast -qp 0 + ALAC (lossless in .mp4);
+    // libx264 ultrafast crf 28 + AAC 128k for quick looks
+    static EncodingProfile makeDelivery();
+    static EncodingProfile makeIntermediate();
+    static EncodingProfile makeDraft();
+};
+
+// Named profiles: the built-ins plus the rules' `global.profiles`
+class EncodingProfiles {
+public:
+    EncodingProfiles();
+
+    // { "name": { "base": "delivery", "video_codec": "libx264", "preset": "medium", "crf": 20, "qp": 0,
+    //   "pix_fmt": "yuv420p", "video_args": "-g 1", "audio_codec": "aac", "audio_bitrate": "160k",
+    //   "intermediate": false }, ... }; unset fields come from base (default "delivery"),
+    // and a built-in name may be redefined
+    void load(const nlohmann::json &profiles);
+
+    // null when no profile has that name
+    const EncodingProfile *find(const std::string &name) const;
+
+    // find(name), or the fallback profile with a warning for an unknown name
+    const EncodingProfile &get(const std::string &name, const std::string &fallback) const;
+
+private:
+    std::map<std::string, EncodingProfile> profiles_;
+};
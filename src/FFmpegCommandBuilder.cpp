@@ -1,7 +1,10 @@
 #include "FFmpegCommandBuilder.h"
+#include "Process.h"
 #include <cmath>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <filesystem>
 
 static std::string doubleToStr(double v) {
     std::ostringstream ss;
@@ -10,6 +13,42 @@ static std::string doubleToStr(double v) {
     return ss.str();
 }
 
+static std::string overlayPosition(const std::string &position) {
+    if (position == "topright") return "x=main_w-overlay_w-10:y=10";
+    if (position == "topleft") return "x=10:y=10";
+    if (position == "bottomright") return "x=main_w-overlay_w-10:y=main_h-overlay_h-10";
+    if (position == "bottomleft") return "x=10:y=main_h-overlay_h-10";
+    return "x=(main_w-overlay_w)/2:y=(main_h-overlay_h)/2";
+}
+
+// asetrate/aresample/atempo: pitch moves, duration stays
+static std::string pitchFilter(double semitones) {
+    double factor = std::pow(2.0, semitones / 12.0);
+    std::ostringstream af;
+    af << "asetrate=48000*" << std::fixed << std::setprecision(6) << factor
+       << ",aresample=48000,atempo=" << (1.0 / factor);
+    return af.str();
+}
+
+static std::string bleepFilter(const std::vector<std::pair<double,double>> &ranges) {
+    // Build expression: if(any range,0,1)
+    // Using FFmpeg expression: if(gt(sum(between(t,a,b),between(t,c,d),...),0),0,1)
+    std::ostringstream expr;
+    expr << "if(gt(";
+    bool first = true;
+    for (auto &r : ranges) {
+        if (!first) expr << "+";
+        expr << "between(t," << doubleToStr(r.first) << "," << doubleToStr(r.second) << ")";
+        first = false;
+    }
+    if (first) {
+        // no ranges -> no-op
+        expr << "0";
+    }
+    expr << ",0),0,1)"; // if sum>0 then 0 else 1 -> volume multiplier
+    return "volume='" + expr.str() + "'";
+}
+
 std::string FFmpegCommandBuilder::quote(const std::string &s) {
     std::string out = "\"";
     for (char c : s) {
@@ -25,24 +64,27 @@ std::string FFmpegCommandBuilder::extractFragmentCmd(const std::string &ffmpegPa
                                                      double start,
                                                      double duration,
                                                      const std::string &output,
-                                                     bool stripAudio,
-                                                     const std::string &vcodec) {
+                                                     const EncodingProfile &profile,
+                                                     bool stripAudio) {
     std::ostringstream cmd;
     cmd << quote(ffmpegPath) << " -y -ss " << doubleToStr(start)
         << " -i " << quote(input)
         << " -t " << doubleToStr(duration)
-        << " -c:v " << vcodec << " -crf 18 -preset veryfast ";
-    if (stripAudio) cmd << " -an ";
-    cmd << quote(output);
+        << profile.videoOptions();
+    cmd << (stripAudio ? " -an" : profile.audioOptions());
+    cmd << " " << quote(output);
     return cmd.str();
 }
 
 std::string FFmpegCommandBuilder::concatFromListCmd(const std::string &ffmpegPath,
                                                     const std::string &listFile,
-                                                    const std::string &output) {
+                                                    const std::string &output,
+                                                    const EncodingProfile *reencode) {
     std::ostringstream cmd;
-    cmd << quote(ffmpegPath) << " -y -f concat -safe 0 -i " << quote(listFile)
-        << " -c copy " << quote(output);
+    cmd << quote(ffmpegPath) << " -y -f concat -safe 0 -i " << quote(listFile);
+    if (reencode) cmd << reencode->videoOptions() << reencode->audioOptions();
+    else cmd << " -c copy";
+    cmd << " " << quote(output);
     return cmd.str();
 }
 
@@ -54,6 +96,85 @@ std::string FFmpegCommandBuilder::makeRepeatConcatCmd(const std::string &ffmpegP
     return concatFromListCmd(ffmpegPath, tmpListPath, outPath);
 }
 
+// loop/aloop buffer the fragment and replay it; size is only an upper bound, both
+// filters shrink it to what they received once the trimmed input hits EOF.
+static std::string loopFilter(int repeats) {
+    return "loop=loop=" + std::to_string(std::max(0, repeats - 1)) + ":size=32767:start=0";
+}
+
+static std::string aloopFilter(int repeats) {
+    return "aloop=loop=" + std::to_string(std::max(0, repeats - 1)) + ":size=2147483647:start=0";
+}
+
+std::string FFmpegCommandBuilder::stutterLoopCmd(const std::string &ffmpegPath,
+                                                 const std::string &input,
+                                                 double start,
+                                                 double duration,
+                                                 int repeats,
+                                                 bool withAudio,
+                                                 const std::string &output,
+                                                 const EncodingProfile &profile) {
+    std::ostringstream fc;
+    fc << "[0:v]setpts=PTS-STARTPTS," << loopFilter(repeats) << "[outv]";
+    if (withAudio) fc << ";[0:a]asetpts=PTS-STARTPTS," << aloopFilter(repeats) << "[outa]";
+
+    std::ostringstream cmd;
+    cmd << quote(ffmpegPath) << " -y -ss " << doubleToStr(start)
+        << " -t " << doubleToStr(duration)
+        << " -i " << quote(input)
+        << " -filter_complex \"" << fc.str() << "\""
+        << " -map \"[outv]\"";
+    if (withAudio) cmd << " -map \"[outa]\"";
+    cmd << profile.videoOptions();
+    if (withAudio) cmd << profile.audioOptions();
+    cmd << " " << quote(output);
+    return cmd.str();
+}
+
+std::string FFmpegCommandBuilder::stutterInPlaceCmd(const std::string &ffmpegPath,
+                                                    const std::string &input,
+                                                    double start,
+                                                    double duration,
+                                                    int repeats,
+                                                    bool withAudio,
+                                                    const std::string &output,
+                                                    const EncodingProfile &profile) {
+    std::string s = doubleToStr(start);
+    std::string d = doubleToStr(duration);
+    std::string e = doubleToStr(start + duration);
+    // a stutter at t=0 has no prefix segment
+    bool prefix = start > 0.0;
+    int parts = prefix ? 3 : 2;
+
+    std::ostringstream fc;
+    fc << "[0:v]split=" << parts << (prefix ? "[vpre]" : "") << "[vst][vpost];";
+    if (prefix) fc << "[vpre]trim=end=" << s << ",setpts=PTS-STARTPTS[v0];";
+    fc << "[vst]trim=start=" << s << ":duration=" << d << ",setpts=PTS-STARTPTS," << loopFilter(repeats) << "[v1];";
+    fc << "[vpost]trim=start=" << e << ",setpts=PTS-STARTPTS[v2];";
+    if (withAudio) {
+        fc << "[0:a]asplit=" << parts << (prefix ? "[apre]" : "") << "[ast][apost];";
+        if (prefix) fc << "[apre]atrim=end=" << s << ",asetpts=PTS-STARTPTS[a0];";
+        fc << "[ast]atrim=start=" << s << ":duration=" << d << ",asetpts=PTS-STARTPTS," << aloopFilter(repeats) << "[a1];";
+        fc << "[apost]atrim=start=" << e << ",asetpts=PTS-STARTPTS[a2];";
+    }
+    for (int i = prefix ? 0 : 1; i < 3; ++i) {
+        fc << "[v" << i << "]";
+        if (withAudio) fc << "[a" << i << "]";
+    }
+    fc << "concat=n=" << parts << ":v=1:a=" << (withAudio ? 1 : 0) << "[outv]";
+    if (withAudio) fc << "[outa]";
+
+    std::ostringstream cmd;
+    cmd << quote(ffmpegPath) << " -y -i " << quote(input)
+        << " -filter_complex \"" << fc.str() << "\""
+        << " -map \"[outv]\"";
+    if (withAudio) cmd << " -map \"[outa]\"";
+    cmd << profile.videoOptions();
+    if (withAudio) cmd << profile.audioOptions();
+    cmd << " " << quote(output);
+    return cmd.str();
+}
+
 std::string FFmpegCommandBuilder::overlayCmd(const std::string &ffmpegPath,
                                              const std::string &mainInput,
                                              const std::string &overlayInput,
@@ -61,38 +182,30 @@ std::string FFmpegCommandBuilder::overlayCmd(const std::string &ffmpegPath,
                                              double enableEnd,
                                              double overlayScale,
                                              const std::string &position,
-                                             const std::string &outPath) {
-    std::string posExpr;
-    if (position == "topright") posExpr = "x=main_w-overlay_w-10:y=10";
-    else if (position == "topleft") posExpr = "x=10:y=10";
-    else if (position == "bottomright") posExpr = "x=main_w-overlay_w-10:y=main_h-overlay_h-10";
-    else if (position == "bottomleft") posExpr = "x=10:y=main_h-overlay_h-10";
-    else posExpr = "x=(main_w-overlay_w)/2:y=(main_h-overlay_h)/2";
-
+                                             const std::string &outPath,
+                                             const EncodingProfile &profile) {
     std::ostringstream fc;
     fc << quote(ffmpegPath) << " -y -i " << quote(mainInput)
        << " -ignore_loop 0 -i " << quote(overlayInput)
        << " -filter_complex \"[1:v] scale=iw*" << overlayScale << ":-1 [ovr];"
-       << "[0:v][ovr] overlay=" << posExpr
+       << "[0:v][ovr] overlay=" << overlayPosition(position)
        << ":enable='between(t," << doubleToStr(enableStart) << "," << doubleToStr(enableEnd) << ")'\""
-       << " -map 0:a? -map 0:v -c:v libx264 -crf 18 -preset veryfast "
-       << quote(outPath);
+       << " -map 0:a? -map 0:v" << profile.videoOptions() << profile.audioOptions()
+       << " " << quote(outPath);
     return fc.str();
 }
 
 std::string FFmpegCommandBuilder::pitchShiftCmd(const std::string &ffmpegPath,
                                                 const std::string &input,
                                                 double semitones,
-                                                const std::string &output) {
-    double factor = std::pow(2.0, semitones / 12.0);
-    std::ostringstream af;
-    af << "asetrate=48000*" << std::fixed << std::setprecision(6) << factor
-       << ",aresample=48000,atempo=" << (1.0 / factor);
-
+                                                const std::string &output,
+                                                const EncodingProfile &profile,
+                                                bool copyVideo) {
     std::ostringstream cmd;
     cmd << quote(ffmpegPath) << " -y -i " << quote(input)
-        << " -af \"" << af.str() << "\""
-        << " -c:v copy -c:a aac -b:a 192k " << quote(output);
+        << " -af \"" << pitchFilter(semitones) << "\""
+        << (copyVideo ? " -c:v copy" : profile.videoOptions()) << profile.audioOptions()
+        << " " << quote(output);
     return cmd.str();
 }
 
@@ -101,13 +214,177 @@ std::string FFmpegCommandBuilder::randomChopExtractCmd(const std::string &ffmpeg
                                                        int idx,
                                                        double start,
                                                        double duration,
-                                                       const std::string &outFragment) {
+                                                       const std::string &outFragment,
+                                                       const EncodingProfile &profile) {
     std::ostringstream cmd;
     cmd << quote(ffmpegPath) << " -y -ss " << doubleToStr(start)
         << " -i " << quote(input)
         << " -t " << doubleToStr(duration)
-        << " -c:v libx264 -crf 24 -preset veryfast -c:a aac -b:a 128k "
-        << quote(outFragment);
+        << profile.videoOptions() << profile.audioOptions()
+        << " " << quote(outFragment);
+    return cmd.str();
+}
+
+std::string FFmpegCommandBuilder::smartCutEdgeOptions(const SourceVideo &source, const EncodingProfile &profile) {
+    if (source.codec != "h264" || source.width <= 0 || source.height <= 0 || source.level <= 0) return "";
+    // ffprobe profile name -> libx264 profile, and the pixel formats it is used with
+    struct Match { const char *name; const char *x264; std::vector<std::string> pixFmts; };
+    static const std::vector<Match> matches = {
+        { "Constrained Baseline", "baseline", { "yuv420p", "yuvj420p" } },
+        { "Baseline", "baseline", { "yuv420p", "yuvj420p" } },
+        { "Main", "main", { "yuv420p", "yuvj420p" } },
+        { "High", "high", { "yuv420p", "yuvj420p" } },
+        { "High 4:2:2", "high422", { "yuv422p", "yuvj422p" } },
+        { "High 4:4:4 Predictive", "high444", { "yuv444p", "yuvj444p" } },
+    };
+    const Match *m = nullptr;
+    for (auto &c : matches) if (source.profile == c.name) m = &c;
+    if (!m || std::find(m->pixFmts.begin(), m->pixFmts.end(), source.pixFmt) == m->pixFmts.end()) return "";
+
+    std::ostringstream out;
+    out << " -c:v libx264 -profile:v " << m->x264 << " -level:v " << source.level / 10 << "." << source.level % 10
+        << " -pix_fmt " << source.pixFmt;
+    // lossless (-qp 0) needs High 4:4:4 Predictive; other profiles get the closest, qp 1
+    if (profile.crf >= 0) out << " -crf " << profile.crf;
+    else if (profile.qp >= 0) out << " -qp " << (profile.qp == 0 && std::string(m->x264) != "high444" ? 1 : profile.qp);
+    // ultrafast turns off CABAC and 8x8 transforms, which would flag the edges Constrained Baseline
+    std::string preset = profile.preset.empty() || profile.preset == "ultrafast" ? "superfast" : profile.preset;
+    out << " -preset " << preset;
+    return out.str();
+}
+
+bool FFmpegCommandBuilder::smartCutPlan(const std::string &ffmpegPath,
+                                        const std::string &input,
+                                        double start,
+                                        double duration,
+                                        const std::vector<double> &keyframes,
+                                        const SourceVideo &source,
+                                        double minCopySeconds,
+                                        const std::string &partPrefix,
+                                        const std::string &listFile,
+                                        bool withAudio,
+                                        const std::string &output,
+                                        const EncodingProfile &profile,
+                                        SmartCutPlan &plan) {
+    // cut points closer than a millisecond to a keyframe need no edge encode
+    const double eps = 0.001;
+    double end = start + duration;
+    auto first = std::lower_bound(keyframes.begin(), keyframes.end(), start - eps);
+    auto last = std::upper_bound(keyframes.begin(), keyframes.end(), end + eps);
+    if (first == keyframes.end() || last == keyframes.begin()) return false;
+    double copyStart = *first;
+    double copyEnd = *(last - 1);
+    if (copyEnd - copyStart < std::max(minCopySeconds, eps)) return false;
+    std::string edgeOptions = smartCutEdgeOptions(source, profile);
+    if (edgeOptions.empty()) return false;
+
+    plan = SmartCutPlan();
+    auto part = [&](double from, double length, bool copy) {
+        std::string file = partPrefix + std::to_string(plan.parts.size()) + ".ts";
+        std::ostringstream cmd;
+        cmd << quote(ffmpegPath) << " -y -ss " << doubleToStr(from)
+            << " -i " << quote(input)
+            << " -t " << doubleToStr(length)
+            << " -map 0:v:0 -an" << (copy ? " -c:v copy" : edgeOptions)
+            << " -f mpegts " << quote(file);
+        plan.partCmds.push_back(cmd.str());
+        plan.parts.push_back(file);
+    };
+    if (copyStart - start > eps) part(start, copyStart - start, false);
+    part(copyStart, copyEnd - copyStart, true);
+    if (end - copyEnd > eps) part(copyEnd, end - copyEnd, false);
+
+    std::ostringstream mux;
+    mux << quote(ffmpegPath) << " -y -f concat -safe 0 -i " << quote(listFile);
+    if (withAudio) {
+        mux << " -ss " << doubleToStr(start) << " -t " << doubleToStr(duration) << " -i " << quote(input)
+            << " -map 0:v -map 1:a? -c:v copy" << profile.audioOptions();
+    } else {
+        mux << " -map 0:v -c:v copy";
+    }
+    mux << " " << quote(output);
+    plan.muxCmd = mux.str();
+    return true;
+}
+
+FFmpegCommandBuilder::ChunkedEncodePlan FFmpegCommandBuilder::chunkedEncodePlan(const std::string &ffmpegPath,
+                                                                                 const std::string &input,
+                                                                                 const std::vector<double> &cuts,
+                                                                                 double duration,
+                                                                                 const std::string &videoFilter,
+                                                                                 bool withAudio,
+                                                                                 const std::string &chunkPrefix,
+                                                                                 const std::string &listFile,
+                                                                                 const std::string &output,
+                                                                                 const EncodingProfile &profile) {
+    ChunkedEncodePlan plan;
+    for (size_t i = 0; i < cuts.size(); ++i) {
+        std::string file = chunkPrefix + std::to_string(i) + ".ts";
+        bool last = i + 1 == cuts.size();
+        std::ostringstream cmd;
+        cmd << quote(ffmpegPath) << " -y -ss " << doubleToStr(cuts[i]) << " -i " << quote(input);
+        // the last chunk runs to the end, whatever the probed duration said
+        if (!last) cmd << " -t " << doubleToStr(cuts[i + 1] - cuts[i]);
+        cmd << " -map 0:v:0 -an";
+        if (!videoFilter.empty()) cmd << " -vf \"" << videoFilter << "\"";
+        cmd << profile.videoOptions() << " -f mpegts " << quote(file);
+        plan.chunkCmds.push_back(cmd.str());
+        plan.chunkSeconds.push_back((last ? duration : cuts[i + 1]) - cuts[i]);
+        plan.chunks.push_back(file);
+    }
+
+    std::ostringstream mux;
+    mux << quote(ffmpegPath) << " -y -f concat -safe 0 -i " << quote(listFile);
+    if (withAudio) {
+        // Matroska holds any audio codec the profile may pick
+        plan.audioFile = chunkPrefix + "audio.mka";
+        std::ostringstream audio;
+        audio << quote(ffmpegPath) << " -y -i " << quote(input) << " -map 0:a:0 -vn" << profile.audioOptions() << " " << quote(plan.audioFile);
+        plan.audioCmd = audio.str();
+        mux << " -i " << quote(plan.audioFile) << " -map 0:v -map 1:a -c copy";
+    } else {
+        mux << " -map 0:v -c copy";
+    }
+    mux << " " << quote(output);
+    plan.muxCmd = mux.str();
+    return plan;
+}
+
+std::string FFmpegCommandBuilder::randomChopFilterScript(const std::vector<std::pair<double,double>> &segments,
+                                                         bool withAudio) {
+    std::ostringstream fc;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        std::string s = doubleToStr(segments[i].first);
+        std::string d = doubleToStr(segments[i].second);
+        fc << "[0:v]trim=start=" << s << ":duration=" << d << ",setpts=PTS-STARTPTS[v" << i << "];\n";
+        if (withAudio) {
+            fc << "[0:a]atrim=start=" << s << ":duration=" << d << ",asetpts=PTS-STARTPTS[a" << i << "];\n";
+        }
+    }
+    for (size_t i = 0; i < segments.size(); ++i) {
+        fc << "[v" << i << "]";
+        if (withAudio) fc << "[a" << i << "]";
+    }
+    fc << "concat=n=" << segments.size() << ":v=1:a=" << (withAudio ? 1 : 0) << "[outv]";
+    if (withAudio) fc << "[outa]";
+    fc << "\n";
+    return fc.str();
+}
+
+std::string FFmpegCommandBuilder::randomChopFilterGraphCmd(const std::string &ffmpegPath,
+                                                           const std::string &input,
+                                                           const std::string &scriptPath,
+                                                           bool withAudio,
+                                                           const std::string &output,
+                                                           const EncodingProfile &profile) {
+    std::ostringstream cmd;
+    cmd << quote(ffmpegPath) << " -y -i " << quote(input)
+        << " -filter_complex_script " << quote(scriptPath)
+        << " -map \"[outv]\"";
+    if (withAudio) cmd << " -map \"[outa]\"";
+    cmd << profile.videoOptions();
+    if (withAudio) cmd << profile.audioOptions();
+    cmd << " " << quote(output);
     return cmd.str();
 }
 
@@ -121,27 +398,104 @@ std::string FFmpegCommandBuilder::concatFilesCmd(const std::string &ffmpegPath,
 std::string FFmpegCommandBuilder::bleepCensorCmd(const std::string &ffmpegPath,
                                                  const std::string &input,
                                                  const std::vector<std::pair<double,double>> &ranges,
-                                                 const std::string &output) {
-    // Build expression: if(any range,0,1)
-    // Using FFmpeg expression: if(gt(sum(between(t,a,b),between(t,c,d),...),0),0,1)
-    std::ostringstream expr;
-    expr << "if(gt(";
-    bool first = true;
-    for (auto &r : ranges) {
-        if (!first) expr << "+";
-        expr << "between(t," << doubleToStr(r.first) << "," << doubleToStr(r.second) << ")";
-        first = false;
+                                                 const std::string &output,
+                                                 const EncodingProfile &profile,
+                                                 bool copyVideo) {
+    std::ostringstream cmd;
+    cmd << quote(ffmpegPath) << " -y -i " << quote(input)
+        << " -af \"" << bleepFilter(ranges) << "\""
+        << (copyVideo ? " -c:v copy" : profile.videoOptions()) << profile.audioOptions()
+        << " " << quote(output);
+    return cmd.str();
+}
+
+std::string FFmpegCommandBuilder::fusedChainCmd(const std::string &ffmpegPath,
+                                                const std::string &input,
+                                                const std::vector<ChainStage> &stages,
+                                                const std::string &output,
+                                                const EncodingProfile &profile,
+                                                bool copyVideo) {
+    std::ostringstream cmd;
+    cmd << quote(ffmpegPath) << " -y -i " << quote(input);
+    std::vector<std::string> audio;
+    std::ostringstream video;
+    std::string videoIn = "[0:v]";
+    int nextInput = 1;
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const ChainStage &st = stages[i];
+        if (st.kind == ChainStage::Kind::Pitch) {
+            audio.push_back(pitchFilter(st.semitones));
+        } else if (st.kind == ChainStage::Kind::Bleep) {
+            audio.push_back(bleepFilter(st.ranges));
+        } else {
+            cmd << " -ignore_loop 0 -i " << quote(st.overlayInput);
+            std::string ovr = "[ovr" + std::to_string(i) + "]";
+            std::string out = "[v" + std::to_string(i) + "]";
+            video << "[" << nextInput++ << ":v] scale=iw*" << st.overlayScale << ":-1 " << ovr << ";"
+                  << videoIn << ovr << " overlay=" << overlayPosition(st.position)
+                  << ":enable='between(t," << doubleToStr(st.enableStart) << "," << doubleToStr(st.enableEnd) << ")' " << out << ";";
+            videoIn = out;
+        }
     }
-    if (first) {
-        // no ranges -> no-op
-        expr << "0";
+    bool overlays = nextInput > 1;
+    if (overlays) {
+        std::string graph = video.str();
+        graph.pop_back(); // trailing ';'
+        cmd << " -filter_complex \"" << graph << "\" -map " << quote(videoIn) << " -map 0:a?";
     }
-    expr << ",0),0,1)"; // if sum>0 then 0 else 1 -> volume multiplier
+    // audio stages stay a simple -af graph on the mapped input audio, so inputs without an
+    // audio stream still work, as with the separate commands
+    if (!audio.empty()) {
+        cmd << " -af \"";
+        for (size_t i = 0; i < audio.size(); ++i) cmd << (i ? "," : "") << audio[i];
+        cmd << "\"";
+    }
+    bool encodeVideo = overlays || !copyVideo;
+    cmd << (encodeVideo ? profile.videoOptions() : " -c:v copy");
+    if (encodeVideo || !audio.empty()) cmd << profile.audioOptions();
+    cmd << " " << quote(output);
+    return cmd.str();
+}
+
+bool FFmpegCommandBuilder::isPlaylist(const std::string &path) {
+    static const std::string ext = ".m3u8";
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
 
+std::string FFmpegCommandBuilder::playlistIoCmd(const std::string &cmd, double segmentSeconds) {
+    if (cmd.find(".m3u8") == std::string::npos) return cmd;
+    std::vector<std::string> argv = util::splitCommandLine(cmd);
+    if (argv.size() < 2) return cmd;
+    std::string out = cmd;
+    // a live playlist is opened 3 segments from its end by default; readers need all of it
+    for (size_t i = 1; i + 1 < argv.size(); ++i) {
+        if (argv[i] != "-i" || !isPlaylist(argv[i + 1])) continue;
+        std::string in = "-i " + quote(argv[i + 1]);
+        size_t pos = out.find(in);
+        if (pos != std::string::npos) out.insert(pos, "-live_start_index 0 ");
+    }
+    const std::string &playlist = argv.back();
+    if (!isPlaylist(playlist)) return out;
+    size_t pos = out.rfind(quote(playlist));
+    if (pos == std::string::npos) return out;
+    std::string seg = doubleToStr(segmentSeconds);
+    std::string dir = std::filesystem::path(playlist).parent_path().string();
+    std::ostringstream hls;
+    if (out.find("-c:v copy") == std::string::npos && out.find("-c copy") == std::string::npos) {
+        hls << "-force_key_frames \"expr:gte(t,n_forced*" << seg << ")\" ";
+    }
+    hls << "-f hls -hls_time " << seg << " -hls_list_size 0 -hls_playlist_type event"
+        << " -hls_segment_type fmp4 -hls_fmp4_init_filename init.mp4"
+        << " -hls_segment_filename " << quote((std::filesystem::path(dir) / "seg_%05d.m4s").string()) << " ";
+    out.insert(pos, hls.str());
+    return out;
+}
+
+std::string FFmpegCommandBuilder::remuxCmd(const std::string &ffmpegPath,
+                                           const std::string &input,
+                                           const std::string &output) {
     std::ostringstream cmd;
-    cmd << quote(ffmpegPath) << " -y -i " << quote(input)
-        << " -af \"volume='" << expr.str() << "'\""
-        << " -c:v copy -c:a aac -b:a 192k " << quote(output);
+    cmd << quote(ffmpegPath) << " -y -i " << quote(input) << " -c copy " << quote(output);
     return cmd.str();
 }
 
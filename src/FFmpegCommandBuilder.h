@@ -1,7 +1,11 @@
 #pragma once
 #include <string>
 #include <vector>
+#include "EncodingProfile.h"
 
+// Commands that encode take the EncodingProfile of the file they write (delivery settings by
+// default); those that can stream-copy video take copyVideo, cleared when the input is an
+// intermediate and the output a final file.
 class FFmpegCommandBuilder {
 public:
     static std::string quote(const std::string &s);
@@ -11,12 +15,14 @@ public:
                                           double start,
                                           double duration,
                                           const std::string &output,
-                                          bool stripAudio = false,
-                                          const std::string &vcodec = "libx264");
+                                          const EncodingProfile &profile = EncodingProfile(),
+                                          bool stripAudio = false);
 
+    // Stream-copies the listed files, or re-encodes them with *reencode when set
     static std::string concatFromListCmd(const std::string &ffmpegPath,
                                          const std::string &listFile,
-                                         const std::string &output);
+                                         const std::string &output,
+                                         const EncodingProfile *reencode = nullptr);
 
     static std::string makeRepeatConcatCmd(const std::string &ffmpegPath,
                                            const std::string &fragmentPath,
@@ -24,6 +30,28 @@ public:
                                            const std::string &outPath,
                                            const std::string &tmpListPath);
 
+    // One-pass stutter: seek to the fragment and repeat it `repeats` times with loop/aloop,
+    // encoding the repeated output directly (no fragment file or concat list).
+    static std::string stutterLoopCmd(const std::string &ffmpegPath,
+                                      const std::string &input,
+                                      double start,
+                                      double duration,
+                                      int repeats,
+                                      bool withAudio,
+                                      const std::string &output,
+                                      const EncodingProfile &profile = EncodingProfile());
+
+    // In-place stutter: the whole clip with the fragment repeated where it occurs
+    // (prefix + stutter + suffix) in a single filtergraph.
+    static std::string stutterInPlaceCmd(const std::string &ffmpegPath,
+                                         const std::string &input,
+                                         double start,
+                                         double duration,
+                                         int repeats,
+                                         bool withAudio,
+                                         const std::string &output,
+                                         const EncodingProfile &profile = EncodingProfile());
+
     static std::string overlayCmd(const std::string &ffmpegPath,
                                   const std::string &mainInput,
                                   const std::string &overlayInput,
@@ -31,19 +59,102 @@ public:
                                   double enableEnd,
                                   double overlayScale,
                                   const std::string &position,
-                                  const std::string &outPath);
+                                  const std::string &outPath,
+                                  const EncodingProfile &profile = EncodingProfile());
 
     static std::string pitchShiftCmd(const std::string &ffmpegPath,
                                      const std::string &input,
                                      double semitones,
-                                     const std::string &output);
+                                     const std::string &output,
+                                     const EncodingProfile &profile = EncodingProfile(),
+                                     bool copyVideo = true);
 
     static std::string randomChopExtractCmd(const std::string &ffmpegPath,
                                             const std::string &input,
                                             int idx,
                                             double start,
                                             double duration,
-                                            const std::string &outFragment);
+                                            const std::string &outFragment,
+                                            const EncodingProfile &profile = EncodingProfile());
+
+    // The h264 stream a smart cut copies from, as probed; the re-encoded edges must match it
+    struct SourceVideo {
+        std::string codec;    // "h264"
+        std::string profile;  // ffprobe's name: "High", "Main", "Constrained Baseline", ...
+        int level = 0;        // level_idc, 31 for 3.1
+        std::string pixFmt;
+        int width = 0;
+        int height = 0;
+    };
+
+    // libx264 options for edges that join the copied GOPs of source: its profile, level and
+    // pix_fmt (parts are not scaled, so the size matches), with profile's rate control and
+    // preset where they fit. Empty when the source can't be matched.
+    static std::string smartCutEdgeOptions(const SourceVideo &source, const EncodingProfile &profile);
+
+    // Smart cut of [start, start + duration): the whole GOPs between the first keyframe at or
+    // after start and the last one at or before the end are stream-copied, only the partial GOPs
+    // at the edges are re-encoded to match the source stream. Video parts are MPEG-TS so each
+    // carries its own parameter sets; the mux joins them with the concat demuxer and adds the
+    // range's audio (encoded with profile).
+    struct SmartCutPlan {
+        std::vector<std::string> partCmds; // independent of each other
+        std::vector<std::string> parts;    // part files in play order, for the concat list
+        std::string muxCmd;                // run once the parts exist, reads listFile
+    };
+
+    // False (nothing planned) when the copyable span is shorter than minCopySeconds or the
+    // source stream can't be matched
+    static bool smartCutPlan(const std::string &ffmpegPath,
+                             const std::string &input,
+                             double start,
+                             double duration,
+                             const std::vector<double> &keyframes,
+                             const SourceVideo &source,
+                             double minCopySeconds,
+                             const std::string &partPrefix,
+                             const std::string &listFile,
+                             bool withAudio,
+                             const std::string &output,
+                             const EncodingProfile &profile,
+                             SmartCutPlan &plan);
+
+    // Chunked encode of a whole file: the video between consecutive cut points is filtered and
+    // encoded by independent commands into MPEG-TS chunks, the audio by one more; the mux joins
+    // the chunks with the concat demuxer and stream-copies both.
+    struct ChunkedEncodePlan {
+        std::vector<std::string> chunkCmds; // video chunks, in play order, independent of each other
+        std::vector<double> chunkSeconds;   // media seconds each chunk command encodes
+        std::vector<std::string> chunks;    // chunk files in play order, for the concat list
+        std::string audioCmd;               // empty without audio
+        std::string audioFile;
+        std::string muxCmd;                 // run once the chunks and audio exist, reads listFile
+    };
+
+    // cuts: ascending chunk start times, the first 0; the last chunk runs to duration
+    static ChunkedEncodePlan chunkedEncodePlan(const std::string &ffmpegPath,
+                                               const std::string &input,
+                                               const std::vector<double> &cuts,
+                                               double duration,
+                                               const std::string &videoFilter,
+                                               bool withAudio,
+                                               const std::string &chunkPrefix,
+                                               const std::string &listFile,
+                                               const std::string &output,
+                                               const EncodingProfile &profile);
+
+    // Filter script for a single-process random chop: one trim/atrim + setpts chain per
+    // (start,duration) segment, all joined by a concat filter into [outv]/[outa].
+    static std::string randomChopFilterScript(const std::vector<std::pair<double,double>> &segments,
+                                              bool withAudio);
+
+    // Decode once / encode once random chop reading the graph from -filter_complex_script
+    static std::string randomChopFilterGraphCmd(const std::string &ffmpegPath,
+                                                const std::string &input,
+                                                const std::string &scriptPath,
+                                                bool withAudio,
+                                                const std::string &output,
+                                                const EncodingProfile &profile = EncodingProfile());
 
     static std::string concatFilesCmd(const std::string &ffmpegPath,
                                       const std::vector<std::string> &files,
@@ -55,7 +166,44 @@ public:
     static std::string bleepCensorCmd(const std::string &ffmpegPath,
                                       const std::string &input,
                                       const std::vector<std::pair<double,double>> &ranges,
-                                      const std::string &output);
+                                      const std::string &output,
+                                      const EncodingProfile &profile = EncodingProfile(),
+                                      bool copyVideo = true);
+
+    // One single-input step of a fused chain (pitch, bleep or overlay parameters)
+    struct ChainStage {
+        enum class Kind { Pitch, Bleep, Overlay };
+        Kind kind = Kind::Pitch;
+        double semitones = 0.0;                        // pitch
+        std::vector<std::pair<double,double>> ranges;  // bleep
+        std::string overlayInput;                      // overlay
+        double enableStart = 0.0;
+        double enableEnd = 9999.0;
+        double overlayScale = 0.2;
+        std::string position = "topright";
+    };
+
+    // A chain of pitch/bleep/overlay steps in one pass: audio filters joined into one -af
+    // graph, overlays chained in one -filter_complex. Video is only re-encoded when the
+    // chain has an overlay (or !copyVideo), as with the separate commands.
+    static std::string fusedChainCmd(const std::string &ffmpegPath,
+                                     const std::string &input,
+                                     const std::vector<ChainStage> &stages,
+                                     const std::string &output,
+                                     const EncodingProfile &profile = EncodingProfile(),
+                                     bool copyVideo = true);
+
+    // Segmented output: a command writing a .m3u8 playlist gets an HLS event playlist of fMP4
+    // segments (segmentSeconds long, keyframes forced on the boundaries when video is encoded)
+    // that readers can follow while it grows; playlist inputs are read from their first segment
+    // instead of live-edge. Other commands are returned unchanged.
+    static bool isPlaylist(const std::string &path);
+    static std::string playlistIoCmd(const std::string &cmd, double segmentSeconds);
+
+    // Stream-copy a finished playlist (or any file) into a single file
+    static std::string remuxCmd(const std::string &ffmpegPath,
+                                const std::string &input,
+                                const std::string &output);
 
     // New: preview command using ffplay to play a file (detached invocation)
     static std::string previewCmd(const std::string &ffplayPath,
@@ -0,0 +1,239 @@
+#include "MediaIndexFile.h"
+#include "MediaManager.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const char kMagic[8] = { 'M', 'D', 'X', 'I', 'D', 'X', '0', '1' };
+const uint32_t kVersion = 2; // 2: codec / pixel format / sample rate fields
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t recordsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t blobsOffset;
+    uint64_t blobsSize;
+    uint64_t reserved;
+};
+
+struct FileRecord {
+    uint32_t pathOff, pathLen;
+    uint32_t fingerprintOff, fingerprintLen;
+    uint32_t normalizedOff, normalizedLen;
+    uint32_t videoCodecOff, videoCodecLen;
+    uint32_t audioCodecOff, audioCodecLen;
+    uint32_t pixelFormatOff, pixelFormatLen;
+    uint32_t typeCode;
+    uint32_t sampleRate;
+    uint16_t width;
+    uint16_t height;
+    uint32_t reserved;
+    double duration;
+    float fps;
+    float keyframeInterval;
+    uint64_t probeOff, probeLen;
+};
+
+static_assert(sizeof(FileHeader) == 64, "unexpected header padding");
+static_assert(sizeof(FileRecord) == 96, "unexpected record padding");
+
+} // namespace
+
+MediaIndexReader::~MediaIndexReader() {
+    close();
+}
+
+bool MediaIndexReader::open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(f, &sz) || sz.QuadPart < (LONGLONG)sizeof(FileHeader)) { CloseHandle(f); return false; }
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) { CloseHandle(f); return false; }
+    void *view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!view) { CloseHandle(m); CloseHandle(f); return false; }
+    file_ = f;
+    mapping_ = m;
+    base_ = (const unsigned char *)view;
+    length_ = (size_t)sz.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FileHeader)) { ::close(fd); return false; }
+    void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file referenced
+    if (view == MAP_FAILED) return false;
+    base_ = (const unsigned char *)view;
+    length_ = (size_t)st.st_size;
+#endif
+
+    FileHeader h;
+    std::memcpy(&h, base_, sizeof(h));
+    bool ok = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.version == kVersion
+        && h.recordsOffset + (uint64_t)h.entryCount * sizeof(FileRecord) <= length_
+        && h.stringsOffset + h.stringsSize <= length_
+        && h.blobsOffset + h.blobsSize <= length_;
+    if (!ok) {
+        close();
+        return false;
+    }
+    count_ = h.entryCount;
+    records_ = base_ + h.recordsOffset;
+    strings_ = (const char *)base_ + h.stringsOffset;
+    stringsSize_ = h.stringsSize;
+    blobs_ = (const char *)base_ + h.blobsOffset;
+    blobsSize_ = h.blobsSize;
+    return true;
+}
+
+void MediaIndexReader::close() {
+    if (!base_) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base_);
+    CloseHandle((HANDLE)mapping_);
+    CloseHandle((HANDLE)file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    munmap((void *)base_, length_);
+#endif
+    base_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+}
+
+MediaIndexRecordView MediaIndexReader::at(size_t i) const {
+    FileRecord r;
+    std::memcpy(&r, records_ + i * sizeof(FileRecord), sizeof(r));
+    auto str = [this](uint32_t off, uint32_t len) {
+        if ((uint64_t)off + len > stringsSize_) return std::string_view();
+        return std::string_view(strings_ + off, len);
+    };
+    MediaIndexRecordView v;
+    v.path = str(r.pathOff, r.pathLen);
+    v.fingerprint = str(r.fingerprintOff, r.fingerprintLen);
+    v.normalizedPath = str(r.normalizedOff, r.normalizedLen);
+    v.videoCodec = str(r.videoCodecOff, r.videoCodecLen);
+    v.audioCodec = str(r.audioCodecOff, r.audioCodecLen);
+    v.pixelFormat = str(r.pixelFormatOff, r.pixelFormatLen);
+    v.type = r.typeCode <= (uint32_t)MediaType::Gif ? (MediaType)r.typeCode : MediaType::Unknown;
+    v.width = r.width;
+    v.height = r.height;
+    v.duration = r.duration;
+    v.fps = r.fps;
+    v.keyframeInterval = r.keyframeInterval;
+    v.sampleRate = r.sampleRate;
+    if (r.probeLen > 0 && r.probeOff + r.probeLen <= blobsSize_) v.probe = std::string_view(blobs_ + r.probeOff, (size_t)r.probeLen);
+    return v;
+}
+
+bool MediaIndexReader::find(std::string_view path, MediaIndexRecordView &out) const {
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        MediaIndexRecordView v = at(mid);
+        int c = v.path.compare(path);
+        if (c == 0) {
+            out = v;
+            return true;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+bool writeMediaIndexFile(const std::string &path,
+                         const std::vector<MediaEntry> &entries,
+                         const std::vector<std::string> &probes) {
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    // byte-wise order, matching std::string_view::compare used by find()
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].path < entries[b].path; });
+
+    std::string strings;
+    std::string blobs;
+    std::vector<FileRecord> records;
+    records.reserve(entries.size());
+    auto addString = [&strings](const std::string &s, uint32_t &off, uint32_t &len) {
+        off = (uint32_t)strings.size();
+        len = (uint32_t)s.size();
+        strings += s;
+    };
+    // codec names repeat across most records; store each one once
+    std::unordered_map<std::string, std::pair<uint32_t, uint32_t>> shared;
+    auto addShared = [&](const char *name, uint32_t &off, uint32_t &len) {
+        auto it = shared.find(name);
+        if (it == shared.end()) {
+            addString(name, off, len);
+            shared.emplace(name, std::make_pair(off, len));
+        } else {
+            off = it->second.first;
+            len = it->second.second;
+        }
+    };
+    for (size_t i : order) {
+        const MediaEntry &e = entries[i];
+        FileRecord r;
+        std::memset(&r, 0, sizeof(r));
+        addString(e.path, r.pathOff, r.pathLen);
+        addString(e.fingerprint, r.fingerprintOff, r.fingerprintLen);
+        addString(e.normalized_path, r.normalizedOff, r.normalizedLen);
+        addShared(e.videoCodec, r.videoCodecOff, r.videoCodecLen);
+        addShared(e.audioCodec, r.audioCodecOff, r.audioCodecLen);
+        addShared(e.pixelFormat, r.pixelFormatOff, r.pixelFormatLen);
+        r.typeCode = (uint32_t)e.type;
+        r.sampleRate = e.sampleRate;
+        r.width = e.width;
+        r.height = e.height;
+        r.duration = e.duration;
+        r.fps = e.fps;
+        r.keyframeInterval = e.keyframeInterval;
+        if (i < probes.size() && !probes[i].empty()) {
+            r.probeOff = blobs.size();
+            r.probeLen = probes[i].size();
+            blobs += probes[i];
+        }
+        records.push_back(r);
+    }
+
+    FileHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.entryCount = (uint32_t)records.size();
+    h.recordsOffset = sizeof(FileHeader);
+    h.stringsOffset = h.recordsOffset + records.size() * sizeof(FileRecord);
+    h.stringsSize = strings.size();
+    h.blobsOffset = h.stringsOffset + strings.size();
+    h.blobsSize = blobs.size();
+
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs) return false;
+    ofs.write((const char *)&h, sizeof(h));
+    if (!records.empty()) ofs.write((const char *)records.data(), (std::streamsize)(records.size() * sizeof(FileRecord)));
+    ofs.write(strings.data(), (std::streamsize)strings.size());
+    ofs.write(blobs.data(), (std::streamsize)blobs.size());
+    ofs.close();
+    return (bool)ofs;
+}
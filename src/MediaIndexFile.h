@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct MediaEntry;
+enum class MediaType : uint8_t;
+
+// Binary media index (workdir/media_index.bin), read through a memory mapping.
+//
+// Layout (native little-endian):
+//   Header   magic "MDXIDX01", version, entry count, section offsets/sizes
+//   Records  entryCount fixed-size records sorted by path (binary searchable)
+//   Strings  path / fingerprint / normalized path / codec name bytes referenced by offset+length
+//   Blobs    optional raw ffprobe JSON per entry, only touched when asked for
+struct MediaIndexRecordView {
+    std::string_view path;
+    std::string_view fingerprint;
+    std::string_view normalizedPath;
+    std::string_view videoCodec;
+    std::string_view audioCodec;
+    std::string_view pixelFormat;
+    std::string_view probe; // raw ffprobe JSON, empty if none was stored
+    MediaType type{};
+    double duration = 0.0;
+    float fps = 0.0f;
+    float keyframeInterval = 0.0f;
+    uint32_t sampleRate = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+};
+
+class MediaIndexReader {
+public:
+    MediaIndexReader() = default;
+    ~MediaIndexReader();
+    MediaIndexReader(const MediaIndexReader &) = delete;
+    MediaIndexReader &operator=(const MediaIndexReader &) = delete;
+
+    // Map the file and validate its header; false if missing or malformed
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return base_ != nullptr; }
+
+    size_t size() const { return count_; }
+    MediaIndexRecordView at(size_t i) const;
+
+    // Binary search by exact path
+    bool find(std::string_view path, MediaIndexRecordView &out) const;
+
+private:
+    const unsigned char *base_ = nullptr;
+    size_t length_ = 0;
+    size_t count_ = 0;
+    const unsigned char *records_ = nullptr;
+    const char *strings_ = nullptr;
+    uint64_t stringsSize_ = 0;
+    const char *blobs_ = nullptr;
+    uint64_t blobsSize_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
+
+// Write entries to path, records sorted by path. probes[i] is the raw probe text stored for
+// entries[i] (empty for none). Returns false on I/O error.
+bool writeMediaIndexFile(const std::string &path,
+                         const std::vector<MediaEntry> &entries,
+                         const std::vector<std::string> &probes);
@@ -1,243 +1,1068 @@
 #include "MediaManager.h"
 #include "Utils.h"
+#include "Process.h"
+#include "MediaIndexFile.h"
+#include "ResourceCoordinator.h"
+#include "Trace.h"
+#include "FFmpegCommandBuilder.h"
 #include <filesystem>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <deque>
 
 namespace fs = std::filesystem;
 
-MediaManager::MediaManager(const std::string &ffmpegPath, const std::string &workdir)
-    : ffmpegPath_(ffmpegPath), workdir_(workdir) {
-    fs::path p(ffmpegPath_);
-    ffprobePath_ = (p.parent_path() / "ffprobe.exe").string();
-    if (!fs::exists(ffprobePath_)) {
-        ffprobePath_ = "ffprobe";
+namespace {
+
+const char *kMediaTypeNames[] = { "unknown", "video", "audio", "image", "gif" };
+
+// Walks ffprobe's JSON output (-show_format -show_streams) as SAX events and keeps only what
+// MediaEntry needs: format.duration and the first video and first audio stream.
+class ProbeSax : public nlohmann::json_sax<json> {
+public:
+    explicit ProbeSax(MediaEntry &e) : e_(e) {}
+
+    MediaType firstStream = MediaType::Unknown;
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t v) override { return number((long long)v); }
+    bool number_unsigned(number_unsigned_t v) override { return number((long long)v); }
+    bool number_float(number_float_t, const string_t &) override { return true; }
+    bool binary(binary_t &) override { return true; }
+
+    bool string(string_t &v) override {
+        if (inFormat() && key_ == "duration") {
+            try { e_.duration = std::stod(v); } catch (...) {}
+        } else if (inStream()) {
+            if (key_ == "codec_type") stream_.codecType = v;
+            else if (key_ == "codec_name") stream_.codecName = v;
+            else if (key_ == "pix_fmt") stream_.pixFmt = v;
+            else if (key_ == "r_frame_rate") stream_.frameRate = v;
+            else if (key_ == "sample_rate") {
+                try { stream_.sampleRate = std::stoll(v); } catch (...) {}
+            }
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        open_.push_back(key_);
+        key_.clear();
+        if (inStream()) stream_ = Stream();
+        return true;
+    }
+    bool end_object() override {
+        if (inStream()) commitStream();
+        open_.pop_back();
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        open_.push_back(key_);
+        key_.clear();
+        return true;
+    }
+    bool end_array() override {
+        open_.pop_back();
+        return true;
+    }
+    bool key(string_t &k) override {
+        key_ = k;
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override { return false; }
+
+private:
+    struct Stream {
+        std::string codecType, codecName, pixFmt, frameRate;
+        long long width = 0, height = 0, sampleRate = 0;
+    };
+
+    MediaEntry &e_;
+    std::vector<std::string> open_; // key that opened each enclosing container ("" inside arrays)
+    std::string key_;
+    Stream stream_;
+    bool haveVideo_ = false;
+    bool haveAudio_ = false;
+
+    // {"format":{...}} and {"streams":[{...}]} at the top level; nested tags/disposition are skipped
+    bool inFormat() const { return open_.size() == 2 && open_[1] == "format"; }
+    bool inStream() const { return open_.size() == 3 && open_[1] == "streams"; }
+
+    bool number(long long v) {
+        if (inStream()) {
+            if (key_ == "width") stream_.width = v;
+            else if (key_ == "height") stream_.height = v;
+        }
+        return true;
+    }
+
+    void commitStream() {
+        if (stream_.codecType == "video" && !haveVideo_) {
+            haveVideo_ = true;
+            if (firstStream == MediaType::Unknown) firstStream = MediaType::Video;
+            e_.width = (uint16_t)std::min<long long>(std::max(0LL, stream_.width), 65535);
+            e_.height = (uint16_t)std::min<long long>(std::max(0LL, stream_.height), 65535);
+            e_.videoCodec = internMediaName(stream_.codecName);
+            e_.pixelFormat = internMediaName(stream_.pixFmt);
+            const std::string &r = stream_.frameRate;
+            try {
+                size_t pos = r.find('/');
+                if (pos != std::string::npos) {
+                    double num = std::stod(r.substr(0, pos));
+                    double den = std::stod(r.substr(pos + 1));
+                    if (den != 0) e_.fps = (float)(num / den);
+                } else if (!r.empty()) {
+                    e_.fps = (float)std::stod(r);
+                }
+            } catch (...) {}
+        } else if (stream_.codecType == "audio" && !haveAudio_) {
+            haveAudio_ = true;
+            if (firstStream == MediaType::Unknown) firstStream = MediaType::Audio;
+            e_.audioCodec = internMediaName(stream_.codecName);
+            e_.sampleRate = (uint32_t)std::max(0LL, stream_.sampleRate);
+        }
+    }
+};
+
+} // namespace
+
+const char *mediaTypeName(MediaType type) {
+    size_t i = (size_t)type;
+    return i < sizeof(kMediaTypeNames) / sizeof(kMediaTypeNames[0]) ? kMediaTypeNames[i] : kMediaTypeNames[0];
+}
+
+MediaType mediaTypeFromName(const std::string &name) {
+    for (size_t i = 1; i < sizeof(kMediaTypeNames) / sizeof(kMediaTypeNames[0]); ++i) {
+        if (name == kMediaTypeNames[i]) return (MediaType)i;
     }
+    return MediaType::Unknown;
+}
+
+const char *internMediaName(const std::string &name) {
+    if (name.empty()) return "";
+    static std::mutex mtx;
+    static std::unordered_set<std::string> names; // nodes never move, so c_str() stays valid
+    std::lock_guard<std::mutex> lk(mtx);
+    return names.insert(name).first->c_str();
+}
+
+MediaManager::MediaManager(const std::string &ffmpegPath, const std::string &workdir, const std::string &indexFormat,
+                           bool keepRawProbes)
+    : ffmpegPath_(ffmpegPath), workdir_(workdir), binaryIndex_(indexFormat == "binary"), keepRawProbes_(keepRawProbes) {
+    ffprobePath_ = util::toolPath(ffmpegPath_, "ffprobe");
     util::ensureDir(workdir_);
     util::ensureDir((fs::path(workdir_) / "normalized").string());
     loadPersistedIndex();
+    writer_ = std::thread([this]() { writerLoop(); });
+}
+
+MediaManager::~MediaManager() {
+    {
+        std::lock_guard<std::mutex> lk(writerMutex_);
+        writerStop_ = true;
+    }
+    writerCv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+}
+
+std::string MediaManager::snapshotPath() const {
+    return (fs::path(workdir_) / (binaryIndex_ ? "media_index.bin" : "media_index.json")).string();
 }
 
 void MediaManager::loadPersistedIndex() {
+    // The binary snapshot is mapped, not parsed; a JSON snapshot is only read when there is
+    // no binary one (JSON mode, or the first run after switching to binary)
     fs::path idxp = fs::path(workdir_) / "media_index.json";
-    if (!fs::exists(idxp)) return;
-    try {
+    if (binaryIndex_ && binIndex_.open(snapshotPath())) {
+        // nothing to parse
+    } else if (fs::exists(idxp)) try {
         std::ifstream ifs(idxp);
         json j;
         ifs >> j;
-        persistedIndex_ = j;
+        if (!j.contains("entries") || !j["entries"].is_array()) return;
+        persisted_.reserve(j["entries"].size());
+        for (auto &pe : j["entries"]) {
+            if (!pe.contains("path") || !pe["path"].is_string()) continue;
+            MediaEntry e = entryFromJson(pe);
+            if (keepRawProbes_ && pe.contains("probe") && pe["probe"].is_object()) rawProbes_[e.path] = pe["probe"].dump();
+            persisted_[e.path] = std::move(e);
+        }
     } catch (...) {}
+
+    // Replay mutations journaled since the last snapshot; a torn final line is ignored
+    std::ifstream jfs(fs::path(workdir_) / "media_index.journal");
+    std::string line;
+    while (std::getline(jfs, line)) {
+        if (line.empty()) continue;
+        try {
+            json rec = json::parse(line);
+            std::string path = rec.at("path").get<std::string>();
+            if (rec.value("op", "") == "remove") {
+                persisted_.erase(path);
+                persistedRemoved_.insert(path);
+            } else if (rec.contains("entry")) {
+                const json &je = rec["entry"];
+                persisted_[path] = entryFromJson(je);
+                if (keepRawProbes_ && je.contains("probe") && je["probe"].is_object()) rawProbes_[path] = je["probe"].dump();
+                persistedRemoved_.erase(path);
+            }
+            ++journalRecords_;
+        } catch (...) {}
+    }
 }
 
-int MediaManager::scanAssets(const std::string &assetsDir) {
-    entries_.clear();
+bool MediaManager::restoreFromPersisted(MediaEntry &e) {
+    if (e.fingerprint.empty()) return false;
+    // journaled entries are newer than the snapshot
+    auto pit = persisted_.find(e.path);
+    if (pit != persisted_.end()) {
+        const MediaEntry &pe = pit->second;
+        if (pe.fingerprint != e.fingerprint) return false;
+        e = pe;
+        // entries without a duration or a recognised type never had a successful probe
+        return pe.duration > 0.0 || pe.type != MediaType::Unknown;
+    }
+    if (persistedRemoved_.count(e.path)) return false;
+
+    std::shared_lock<std::shared_mutex> lk(binIndexMutex_);
+    MediaIndexRecordView rec;
+    if (!binIndex_.isOpen() || !binIndex_.find(e.path, rec) || rec.fingerprint != e.fingerprint) return false;
+    // typed fields come straight from the record; nothing is parsed
+    e.normalized_path = std::string(rec.normalizedPath);
+    e.type = rec.type;
+    e.duration = rec.duration;
+    e.width = rec.width;
+    e.height = rec.height;
+    e.fps = rec.fps;
+    e.keyframeInterval = rec.keyframeInterval;
+    e.sampleRate = rec.sampleRate;
+    e.videoCodec = internMediaName(std::string(rec.videoCodec));
+    e.audioCodec = internMediaName(std::string(rec.audioCodec));
+    e.pixelFormat = internMediaName(std::string(rec.pixelFormat));
+    return rec.duration > 0.0 || rec.type != MediaType::Unknown;
+}
+
+json MediaManager::entryToJson(const MediaEntry &e, const std::string &probeText) {
+    json je;
+    je["path"] = e.path;
+    je["type"] = mediaTypeName(e.type);
+    je["duration"] = e.duration;
+    je["width"] = e.width;
+    je["height"] = e.height;
+    je["fps"] = e.fps;
+    je["keyframe_interval"] = e.keyframeInterval;
+    je["video_codec"] = e.videoCodec;
+    je["audio_codec"] = e.audioCodec;
+    je["pixel_format"] = e.pixelFormat;
+    je["sample_rate"] = e.sampleRate;
+    je["fingerprint"] = e.fingerprint;
+    je["normalized_path"] = e.normalized_path;
+    if (!probeText.empty()) {
+        json probe = json::parse(probeText, nullptr, false);
+        if (!probe.is_discarded()) je["probe"] = std::move(probe);
+    }
+    return je;
+}
+
+MediaEntry MediaManager::entryFromJson(const json &je) {
+    MediaEntry e;
+    try {
+        e.path = je.value("path", "");
+        e.fingerprint = je.value("fingerprint", "");
+        e.normalized_path = je.value("normalized_path", "");
+        if (!je.contains("video_codec") && je.contains("probe") && je["probe"].is_object()) {
+            // index written before typed fields were stored: derive them from the probe once
+            parseProbe(je["probe"].dump(), e);
+            e.type = inferType(e.path, e.type);
+            return e;
+        }
+        e.type = mediaTypeFromName(je.value("type", ""));
+        e.duration = je.value("duration", 0.0);
+        e.width = (uint16_t)je.value("width", 0);
+        e.height = (uint16_t)je.value("height", 0);
+        e.fps = je.value("fps", 0.0f);
+        e.keyframeInterval = je.value("keyframe_interval", 0.0f);
+        e.sampleRate = je.value("sample_rate", 0u);
+        e.videoCodec = internMediaName(je.value("video_codec", ""));
+        e.audioCodec = internMediaName(je.value("audio_codec", ""));
+        e.pixelFormat = internMediaName(je.value("pixel_format", ""));
+    } catch (...) {}
+    return e;
+}
+
+void MediaManager::journal(const json &record) {
+    {
+        std::lock_guard<std::mutex> lk(writerMutex_);
+        journalQueue_.push_back(record.dump());
+    }
+    writerCv_.notify_all();
+}
+
+void MediaManager::writerLoop() {
+    fs::path journalPath = fs::path(workdir_) / "media_index.journal";
+    std::unique_lock<std::mutex> lk(writerMutex_);
+    while (true) {
+        writerCv_.wait(lk, [this]() { return writerStop_ || !journalQueue_.empty() || compactRequested_; });
+        if (journalQueue_.empty() && !compactRequested_) break; // stopping with nothing left
+        std::deque<std::string> batch;
+        batch.swap(journalQueue_);
+        bool compact = compactRequested_;
+        compactRequested_ = false;
+        writerBusy_ = true;
+        lk.unlock();
+
+        if (!batch.empty()) {
+            std::ofstream ofs(journalPath, std::ios::app);
+            for (auto &l : batch) ofs << l << '\n';
+            ofs.flush();
+            journalRecords_ += batch.size();
+        }
+        // Fold the journal into a fresh snapshot when asked to or once it has grown
+        if (compact || journalRecords_ >= kCompactEvery) {
+            if (writeSnapshot()) {
+                std::ofstream trunc(journalPath, std::ios::trunc);
+                journalRecords_ = 0;
+                lastSnapshotOk_ = true;
+            } else {
+                lastSnapshotOk_ = false;
+            }
+        }
+
+        lk.lock();
+        writerBusy_ = false;
+        writerIdleCv_.notify_all();
+    }
+}
+
+void MediaManager::flushIndex() {
+    std::unique_lock<std::mutex> lk(writerMutex_);
+    writerIdleCv_.wait(lk, [this]() { return journalQueue_.empty() && !compactRequested_ && !writerBusy_; });
+}
+
+void MediaManager::rebuildLookupsLocked() {
+    pathIndex_.clear();
+    fingerprintIndex_.clear();
+    pathIndex_.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        pathIndex_[entries_[i].path] = i;
+        if (!entries_[i].fingerprint.empty()) fingerprintIndex_.emplace(entries_[i].fingerprint, i);
+    }
+}
+
+std::vector<MediaEntry> MediaManager::entries() const {
+    std::shared_lock<std::shared_mutex> lk(indexMutex_);
+    return entries_;
+}
+
+bool MediaManager::findEntry(const std::string &path, MediaEntry &out) const {
+    std::shared_lock<std::shared_mutex> lk(indexMutex_);
+    auto it = pathIndex_.find(path);
+    if (it == pathIndex_.end()) return false;
+    out = entries_[it->second];
+    return true;
+}
+
+std::vector<MediaEntry> MediaManager::findByFingerprint(const std::string &fingerprint) const {
+    std::shared_lock<std::shared_mutex> lk(indexMutex_);
+    std::vector<MediaEntry> out;
+    auto range = fingerprintIndex_.equal_range(fingerprint);
+    for (auto it = range.first; it != range.second; ++it) out.push_back(entries_[it->second]);
+    return out;
+}
+
+bool MediaManager::parseProbe(const std::string &text, MediaEntry &e) {
+    ProbeSax sax(e);
+    bool ok = json::sax_parse(text, &sax);
+    // parseProbe's caller decides the final type; stash what the streams say
+    e.type = sax.firstStream;
+    return ok;
+}
+
+std::vector<std::string> MediaManager::discoverFiles(const std::string &assetsDir, util::ThreadPool &pool) {
+    std::vector<std::string> files;
+    std::mutex mtx;
+    // One task per directory; each lists its own files and enqueues its subdirectories
+    std::function<void(fs::path)> walk = [&](fs::path dir) {
+        std::vector<std::string> local;
+        std::error_code ec;
+        for (fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), endIt; !ec && it != endIt; it.increment(ec)) {
+            std::error_code sec;
+            // like recursive_directory_iterator, don't follow directory symlinks: one
+            // pointing back up the tree would enqueue walks forever
+            bool linked = it->is_symlink(sec);
+            if (it->is_directory(sec)) {
+                if (linked) continue;
+                fs::path sub = it->path();
+                pool.enqueue([&walk, sub]() { walk(sub); });
+            } else if (it->is_regular_file(sec)) {
+                local.push_back(it->path().string());
+            }
+        }
+        std::lock_guard<std::mutex> lk(mtx);
+        files.insert(files.end(), local.begin(), local.end());
+    };
+    pool.enqueue([&walk, assetsDir]() { walk(fs::path(assetsDir)); });
+    pool.waitAll();
+    // traversal order depends on thread timing; sort for a stable, deterministic index
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+int MediaManager::scanAssets(const std::string &assetsDir, int workerCount) {
+    Trace::Span span("media", "scanAssets");
+    {
+        std::unique_lock<std::shared_mutex> lk(indexMutex_);
+        entries_.clear();
+        rebuildLookupsLocked();
+    }
     if (!fs::exists(assetsDir)) {
         std::cerr << "Assets directory not found: " << assetsDir << std::endl;
         return 0;
     }
-    for (auto &it : fs::recursive_directory_iterator(assetsDir)) {
-        if (!it.is_regular_file()) continue;
-        std::string path = it.path().string();
-        json probe;
-        probeFile(path, probe); // may fail but we'll still add entry
-        MediaEntry e;
-        e.path = path;
-        e.rawProbe = probe;
-        e.type = inferType(probe, path);
-        try {
-            if (probe.contains("format") && probe["format"].contains("duration")) {
-                e.duration = std::stod(probe["format"]["duration"].get<std::string>());
-            }
-        } catch (...) {}
-        try {
-            for (auto &s : probe["streams"]) {
-                if (s.contains("codec_type") && s["codec_type"] == "video") {
-                    if (s.contains("width")) e.width = s["width"].get<int>();
-                    if (s.contains("height")) e.height = s["height"].get<int>();
-                    if (s.contains("r_frame_rate")) {
-                        std::string r = s["r_frame_rate"].get<std::string>();
-                        size_t pos = r.find('/');
-                        if (pos != std::string::npos) {
-                            double num = std::stod(r.substr(0,pos));
-                            double den = std::stod(r.substr(pos+1));
-                            if (den != 0) e.fps = num/den;
-                        } else {
-                            e.fps = std::stod(r);
-                        }
-                    }
-                    break;
-                }
-            }
-        } catch (...) {}
-        e.fingerprint = util::fileFingerprint(path);
-
-        // attempt to recover normalized path from persistedIndex_ if fingerprint matches
-        if (!persistedIndex_.is_null() && persistedIndex_.contains("entries")) {
-            for (auto &pe : persistedIndex_["entries"]) {
-                try {
-                    if (pe.contains("path") && pe["path"] == e.path && pe.contains("fingerprint") && pe["fingerprint"] == e.fingerprint && pe.contains("normalized_path")) {
-                        e.normalized_path = pe["normalized_path"].get<std::string>();
-                        break;
-                    }
-                } catch (...) {}
+    if (workerCount <= 0) {
+        // probing is mostly process startup and I/O wait: one worker per core
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = (int)std::max(1u, cores);
+    }
+    util::ThreadPool pool((size_t)workerCount);
+    std::vector<std::string> files = discoverFiles(assetsDir, pool);
+
+    // Each worker fills its own pre-sized slot, so entries_ keeps the sorted path order
+    std::vector<MediaEntry> scanned(files.size());
+    std::atomic<int> probeHits{0};
+    std::atomic<int> probeMisses{0};
+    std::vector<char> changed(files.size(), 0);
+    std::vector<std::string> scannedProbes(keepRawProbes_ ? files.size() : 0);
+    for (size_t i = 0; i < files.size(); ++i) {
+        pool.enqueue([this, i, &files, &scanned, &changed, &probeHits, &probeMisses, &scannedProbes]() {
+            MediaEntry &e = scanned[i];
+            e.path = files[i];
+            e.fingerprint = util::fileFingerprint(e.path);
+
+            // An unchanged file (same fingerprint) keeps its persisted probe and normalized path.
+            // The persisted index is only read here, so workers share it.
+            if (restoreFromPersisted(e)) {
+                ++probeHits;
+            } else {
+                std::string probe;
+                if (probeFile(e.path, probe)) parseProbe(probe, e); // may fail but we'll still add entry
+                e.type = inferType(e.path, e.type);
+                if (keepRawProbes_) scannedProbes[i] = std::move(probe);
+                ++probeMisses;
+                changed[i] = 1;
             }
+        });
+    }
+    pool.waitAll();
+    {
+        std::unique_lock<std::shared_mutex> lk(indexMutex_);
+        entries_ = std::move(scanned);
+        rebuildLookupsLocked();
+        for (size_t i = 0; i < scannedProbes.size(); ++i) {
+            if (!scannedProbes[i].empty()) rawProbes_[entries_[i].path] = std::move(scannedProbes[i]);
         }
+    }
+
+    std::cout << "MediaManager: probe cache " << probeHits.load() << " hits, " << probeMisses.load() << " misses (ffprobe runs)\n";
 
-        entries_.push_back(e);
+    // Journal only what differs from the persisted index: new/changed files and vanished ones
+    std::vector<MediaEntry> current = entries();
+    std::unordered_map<std::string, char> seen;
+    seen.reserve(current.size());
+    for (size_t i = 0; i < current.size(); ++i) {
+        seen[current[i].path] = 1;
+        if (changed[i]) journal({ {"op", "upsert"}, {"path", current[i].path}, {"entry", entryToJson(current[i], keptProbe(current[i].path))} });
     }
-    saveIndex();
-    return (int)entries_.size();
+    for (auto &kv : persisted_) {
+        if (!seen.count(kv.first)) journal({ {"op", "remove"}, {"path", kv.first} });
+    }
+    {
+        std::shared_lock<std::shared_mutex> lk(binIndexMutex_);
+        for (size_t i = 0; i < binIndex_.size(); ++i) {
+            std::string path(binIndex_.at(i).path);
+            if (!seen.count(path) && !persisted_.count(path) && !persistedRemoved_.count(path)) {
+                journal({ {"op", "remove"}, {"path", path} });
+            }
+        }
+    }
+    if (!fs::exists(snapshotPath())) saveIndex(); // first run: create the snapshot
+    else flushIndex();
+    return (int)current.size();
 }
 
-bool MediaManager::probeFile(const std::string &path, json &out) {
-    std::ostringstream cmd;
-    cmd << util::quote(ffprobePath_) << " -v quiet -print_format json -show_format -show_streams " << util::quote(path);
-    auto pr = util::runCapture(cmd.str());
-    if (pr.first != 0 && pr.second.empty()) {
+bool MediaManager::probeFile(const std::string &path, std::string &out) {
+    util::ProcessOptions opts;
+    opts.captureStdout = true;
+    std::vector<std::string> argv = { ffprobePath_, "-v", "quiet", "-print_format", "json", "-show_format", "-show_streams", path };
+    auto pr = util::runProcess(argv, opts);
+    Trace::recordChild("ffprobe " + fs::path(path).filename().string(), argv, pr);
+    if (pr.exitCode != 0 && pr.out.empty()) {
         return false;
     }
-    try {
-        out = json::parse(pr.second);
-        return true;
-    } catch (...) {
-        return false;
+    out = std::move(pr.out);
+    return true;
+}
+
+bool MediaManager::rawProbe(const std::string &path, json &out) {
+    std::string fingerprint = util::fileFingerprint(path);
+    MediaEntry known;
+    if (keepRawProbes_ && findEntry(path, known) && known.fingerprint == fingerprint) {
+        std::string text;
+        {
+            std::shared_lock<std::shared_mutex> lk(indexMutex_);
+            auto it = rawProbes_.find(path);
+            if (it != rawProbes_.end()) text = it->second;
+        }
+        if (text.empty()) {
+            std::shared_lock<std::shared_mutex> lk(binIndexMutex_);
+            text = storedProbe(known);
+        }
+        if (!text.empty()) {
+            out = json::parse(text, nullptr, false);
+            if (!out.is_discarded()) return true;
+        }
     }
+    std::string text;
+    if (!probeFile(path, text)) return false;
+    out = json::parse(text, nullptr, false);
+    return !out.is_discarded();
 }
 
-std::string MediaManager::inferType(const json &probeJson, const std::string &path) {
+MediaType MediaManager::inferType(const std::string &path, MediaType firstStream) {
     std::string ext = fs::path(path).extension().string();
     for (auto &c : ext) c = (char)tolower(c);
-    if (ext == ".mp4" || ext == ".mov" || ext == ".mkv" || ext == ".webm" || ext == ".avi") return "video";
-    if (ext == ".mp3" || ext == ".wav" || ext == ".aac" || ext == ".flac" || ext == ".m4a") return "audio";
-    if (ext == ".gif") return "gif";
-    if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp") return "image";
-    try {
-        if (probeJson.contains("streams")) {
-            for (auto &s : probeJson["streams"]) {
-                if (s.contains("codec_type") && s["codec_type"] == "video") return "video";
-                if (s.contains("codec_type") && s["codec_type"] == "audio") return "audio";
-            }
-        }
-    } catch (...) {}
-    return "unknown";
+    if (ext == ".mp4" || ext == ".mov" || ext == ".mkv" || ext == ".webm" || ext == ".avi") return MediaType::Video;
+    if (ext == ".mp3" || ext == ".wav" || ext == ".aac" || ext == ".flac" || ext == ".m4a") return MediaType::Audio;
+    if (ext == ".gif") return MediaType::Gif;
+    if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp") return MediaType::Image;
+    return firstStream;
+}
+
+// scale with pad/preserve aspect and fps filter
+static std::string scaleFilter(int width, int height, double fps) {
+    std::ostringstream vf;
+    vf << "scale=w=" << width << ":h=" << height << ":force_original_aspect_ratio=decrease";
+    vf << ",pad=" << width << ":" << height << ":(ow-iw)/2:(oh-ih)/2";
+    if (fps > 0.0) vf << ",fps=" << std::fixed << std::setprecision(2) << fps;
+    return vf.str();
+}
+
+std::string MediaManager::normalizedPathFor(const std::string &inputPath) const {
+    return (fs::path(workdir_) / "normalized" / (fs::path(inputPath).stem().string() + "_norm.mp4")).string();
 }
 
-std::string MediaManager::normalizeMedia(const std::string &inputPath, int targetWidth, int targetHeight, double targetFps) {
-    fs::path in(inputPath);
+std::string MediaManager::normalizeMedia(const std::string &inputPath, int targetWidth, int targetHeight, double targetFps,
+                                         util::ThreadPool *pool) {
+    Trace::Span span("normalize", fs::path(inputPath).filename().string());
     std::string fingerprint = util::fileFingerprint(inputPath);
-    std::string base = in.stem().string();
-    fs::path out = fs::path(workdir_) / "normalized" / (base + "_norm.mp4");
+    fs::path out = normalizedPathFor(inputPath);
 
     // If we already have a normalized path recorded for this fingerprint, skip
-    for (auto &e : entries_) {
-        if (e.path == inputPath && !e.normalized_path.empty() && e.fingerprint == fingerprint && fs::exists(e.normalized_path)) {
-            // Skip re-normalization
-            return e.normalized_path;
-        }
+    MediaEntry known;
+    if (findEntry(inputPath, known) && !known.normalized_path.empty() && known.fingerprint == fingerprint && fs::exists(known.normalized_path)) {
+        // Skip re-normalization
+        span.arg("reused", true);
+        return known.normalized_path;
     }
 
-    // Build vf: scale with pad/preserve aspect and fps filter
-    std::ostringstream vf;
-    vf << "scale=w=" << targetWidth << ":h=" << targetHeight << ":force_original_aspect_ratio=decrease";
-    vf << ",pad=" << targetWidth << ":" << targetHeight << ":(ow-iw)/2:(oh-ih)/2";
-    if (targetFps > 0.0) vf << ",fps=" << std::fixed << std::setprecision(2) << targetFps;
-
-    std::ostringstream cmd;
-    cmd << util::quote(ffmpegPath_) << " -y -i " << util::quote(inputPath)
-        << " -vf \"" << vf.str() << "\" -c:v libx264 -crf 20 -preset veryfast -c:a aac -b:a 128k "
-        << util::quote(out.string());
-    int rc = util::runCommand(cmd.str());
+    std::string vf = scaleFilter(targetWidth, targetHeight, targetFps);
+    JobShape shape;
+    shape.width = std::max<int>(known.width, targetWidth);
+    shape.height = std::max<int>(known.height, targetHeight);
+    shape.codec = known.videoCodec;
+    int rc = 0;
+    std::vector<double> cuts = chunkCuts(known, pool);
+    if (cuts.size() >= 2) {
+        span.arg("chunks", (int)cuts.size());
+        rc = runChunkedEncode(inputPath, known, cuts, vf, out.string(), shape, *pool);
+    } else {
+        std::ostringstream cmd;
+        cmd << util::quote(ffmpegPath_) << " -y -i " << util::quote(inputPath)
+            << " -vf \"" << vf << "\"" << encodingProfile_.videoOptions() << encodingProfile_.audioOptions()
+            << " " << util::quote(out.string());
+        rc = runEncode(cmd.str(), known.duration, shape);
+    }
     if (rc != 0) return "";
 
     // Update entries_ metadata
-    for (auto &e : entries_) {
-        if (e.path == inputPath) {
+    {
+        std::unique_lock<std::shared_mutex> lk(indexMutex_);
+        auto it = pathIndex_.find(inputPath);
+        if (it != pathIndex_.end()) {
+            MediaEntry &e = entries_[it->second];
+            if (e.fingerprint != fingerprint) {
+                auto range = fingerprintIndex_.equal_range(e.fingerprint);
+                for (auto f = range.first; f != range.second; ++f) {
+                    if (f->second == it->second) { fingerprintIndex_.erase(f); break; }
+                }
+                e.fingerprint = fingerprint;
+                if (!fingerprint.empty()) fingerprintIndex_.emplace(fingerprint, it->second);
+            }
             e.normalized_path = out.string();
-            e.fingerprint = fingerprint;
-            break;
+            auto pit = rawProbes_.find(e.path);
+            journal({ {"op", "upsert"}, {"path", e.path}, {"entry", entryToJson(e, pit != rawProbes_.end() ? pit->second : "")} });
         }
     }
-    saveIndex();
     return out.string();
 }
 
+std::vector<double> MediaManager::chunkCuts(const MediaEntry &known, util::ThreadPool *pool) {
+    std::vector<double> cuts;
+    if (!chunked_ || !pool || chunkMinSeconds_ <= 0.0 || known.duration < 2.0 * chunkMinSeconds_) return cuts;
+    // as many chunks as can encode at once, none shorter than the minimum
+    size_t slots = pool->workerCount();
+    if (coordinator_) slots = std::min<size_t>(slots, (size_t)std::max(1, coordinator_->maxJobs()));
+    size_t count = std::min<size_t>(slots, (size_t)(known.duration / chunkMinSeconds_));
+    if (count < 2) return cuts;
+
+    // cut at the keyframe nearest each even split, so no chunk decodes frames it then drops
+    std::vector<double> keyframes = keyframeTimes(known.path);
+    double step = known.duration / (double)count;
+    cuts.push_back(0.0);
+    for (size_t i = 1; i < count; ++i) {
+        double target = step * (double)i;
+        if (!keyframes.empty()) {
+            auto it = std::lower_bound(keyframes.begin(), keyframes.end(), target);
+            if (it == keyframes.end() || (it != keyframes.begin() && target - *(it - 1) < *it - target)) --it;
+            target = *it;
+        }
+        // sparse keyframes can pull neighbouring cuts together; keep each chunk worth its process
+        if (target - cuts.back() >= chunkMinSeconds_ / 2.0 && known.duration - target >= chunkMinSeconds_ / 2.0) cuts.push_back(target);
+    }
+    if (cuts.size() < 2) cuts.clear();
+    return cuts;
+}
+
+int MediaManager::runChunkedEncode(const std::string &inputPath, const MediaEntry &known, const std::vector<double> &cuts,
+                                   const std::string &videoFilter, const std::string &out, const JobShape &shape, util::ThreadPool &pool) {
+    fs::path outPath(out);
+    std::string prefix = (outPath.parent_path() / (outPath.stem().string() + "_chunk")).string();
+    std::string listFile = prefix + "s.txt";
+    bool withAudio = known.audioCodec[0] != '\0';
+    FFmpegCommandBuilder::ChunkedEncodePlan plan = FFmpegCommandBuilder::chunkedEncodePlan(
+        ffmpegPath_, inputPath, cuts, known.duration, videoFilter, withAudio, prefix, listFile, out, encodingProfile_);
+    {
+        std::ofstream ofs(listFile);
+        for (auto &c : plan.chunks) ofs << "file '" << fs::absolute(c).string() << "'\n";
+    }
+
+    // the chunks of one input share its priority, so the longest input's chunks go first;
+    // once one fails the unstarted ones are dropped
+    int priority = (int)std::min(known.duration * 1000.0, 2.0e9);
+    std::atomic<int> rc{0};
+    {
+        util::TaskGroup group(pool);
+        auto run = [this, &rc, &group, shape](const std::string &cmd, double seconds) {
+            int r = runEncode(cmd, seconds, shape);
+            if (r == 0) return;
+            int expected = 0;
+            rc.compare_exchange_strong(expected, r);
+            group.cancel();
+        };
+        for (size_t i = 0; i < plan.chunkCmds.size(); ++i) {
+            std::string cmd = plan.chunkCmds[i];
+            double seconds = plan.chunkSeconds[i];
+            group.run([&run, cmd, seconds]() { run(cmd, seconds); }, priority);
+        }
+        if (!plan.audioCmd.empty()) {
+            std::string cmd = plan.audioCmd;
+            group.run([&run, cmd]() { run(cmd, 0.0); }, priority);
+        }
+        group.wait();
+    }
+    if (rc.load() == 0) rc = runEncode(plan.muxCmd, 0.0, shape);
+
+    std::error_code ec;
+    for (auto &c : plan.chunks) fs::remove(c, ec);
+    if (!plan.audioFile.empty()) fs::remove(plan.audioFile, ec);
+    fs::remove(listFile, ec);
+    return rc.load();
+}
+
 bool MediaManager::normalizeAll(int workerCount, int targetWidth, int targetHeight, double targetFps) {
+    Trace::Span span("media", "normalizeAll");
     if (workerCount <= 0) workerCount = 1;
     util::ThreadPool pool((size_t)workerCount);
     std::atomic<int> tasksSubmitted{0};
 
-    for (auto &e : entries_) {
-        if (e.type == "video" || e.type == "gif") {
+    // the workers grab the first tasks as soon as they are queued, so queue longest first too
+    std::vector<MediaEntry> todo = entries();
+    std::stable_sort(todo.begin(), todo.end(), [](const MediaEntry &a, const MediaEntry &b) { return a.duration > b.duration; });
+    for (auto &e : todo) {
+        if (e.type == MediaType::Video || e.type == MediaType::Gif) {
             // If normalized exists and fingerprint matches, skip scheduling
             if (!e.normalized_path.empty() && fs::exists(e.normalized_path)) {
                 // Already normalized
                 continue;
             }
             std::string inputPath = e.path;
-            pool.enqueue([this, inputPath, targetWidth, targetHeight, targetFps, &tasksSubmitted](){
-                std::string out = this->normalizeMedia(inputPath, targetWidth, targetHeight, targetFps);
+            // longest inputs first so a big file started last doesn't straggle alone at the end
+            int priority = (int)std::min(e.duration * 1000.0, 2.0e9);
+            pool.enqueue([this, inputPath, targetWidth, targetHeight, targetFps, &tasksSubmitted, &pool](){
+                std::string out = this->normalizeMedia(inputPath, targetWidth, targetHeight, targetFps, &pool);
                 if (out.empty()) {
                     std::cerr << "Normalization failed for: " << inputPath << std::endl;
                 } else {
                     std::cout << "Normalized: " << inputPath << " -> " << out << std::endl;
                 }
                 tasksSubmitted++;
-            });
+            }, priority);
         }
     }
 
     pool.waitAll();
-    // final save to ensure persisted info
-    saveIndex();
+    // make sure every worker's journal record reached disk
+    flushIndex();
     return true;
 }
 
+std::string MediaManager::proxyPathFor(const std::string &inputPath) const {
+    return (fs::path(workdir_) / "proxies" / (fs::path(inputPath).stem().string() + "_proxy.mp4")).string();
+}
+
+void MediaManager::loadProxyManifestLocked() {
+    if (proxyManifestLoaded_) return;
+    proxyManifestLoaded_ = true;
+    std::ifstream ifs(fs::path(workdir_) / "proxies" / "proxies.json");
+    if (!ifs) return;
+    json j = json::parse(ifs, nullptr, false);
+    if (j.is_object()) proxyManifest_ = j;
+}
+
+bool MediaManager::saveProxyManifest() {
+    fs::path path = fs::path(workdir_) / "proxies" / "proxies.json";
+    fs::path tmp = path.string() + ".tmp";
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lk(proxyMutex_);
+        text = proxyManifest_.dump(1);
+    }
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs) return false;
+        ofs << text;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+std::string MediaManager::makeProxy(const std::string &inputPath, int width, int height, double fps) {
+    Trace::Span span("proxy", fs::path(inputPath).filename().string());
+    std::string fingerprint = util::fileFingerprint(inputPath);
+    fs::path out = proxyPathFor(inputPath);
+    std::ostringstream settings;
+    settings << width << "x" << height << "@" << fps << proxyProfile_.videoOptions() << proxyProfile_.audioOptions();
+    {
+        std::lock_guard<std::mutex> lk(proxyMutex_);
+        loadProxyManifestLocked();
+        auto it = proxyManifest_.find(inputPath);
+        if (it != proxyManifest_.end() && it->value("fingerprint", "") == fingerprint && it->value("settings", "") == settings.str()
+            && fs::exists(out)) {
+            span.arg("reused", true);
+            return out.string();
+        }
+    }
+
+    std::ostringstream cmd;
+    cmd << util::quote(ffmpegPath_) << " -y -i " << util::quote(inputPath)
+        << " -vf \"" << scaleFilter(width, height, fps) << "\"" << proxyProfile_.videoOptions() << proxyProfile_.audioOptions()
+        << " " << util::quote(out.string());
+    MediaEntry known;
+    findEntry(inputPath, known);
+    JobShape shape;
+    shape.width = std::max<int>(known.width, width);
+    shape.height = std::max<int>(known.height, height);
+    shape.codec = known.videoCodec;
+    if (runEncode(cmd.str(), known.duration, shape) != 0) return "";
+
+    std::lock_guard<std::mutex> lk(proxyMutex_);
+    proxyManifest_[inputPath] = { {"fingerprint", fingerprint}, {"settings", settings.str()}, {"proxy", out.string()} };
+    return out.string();
+}
+
+int MediaManager::makeProxies(int workerCount, int width, int height, double fps) {
+    Trace::Span span("media", "makeProxies");
+    util::ensureDir((fs::path(workdir_) / "proxies").string());
+    std::atomic<int> ready{0};
+    {
+        util::ThreadPool pool((size_t)std::max(1, workerCount));
+        for (auto &e : entries()) {
+            if (e.type != MediaType::Video && e.type != MediaType::Gif) continue;
+            std::string inputPath = e.path;
+            // longest first, as in normalizeAll
+            int priority = (int)std::min(e.duration * 1000.0, 2.0e9);
+            pool.enqueue([this, inputPath, width, height, fps, &ready]() {
+                if (makeProxy(inputPath, width, height, fps).empty()) std::cerr << "Proxy failed for: " << inputPath << std::endl;
+                else ++ready;
+            }, priority);
+        }
+        pool.waitAll();
+    }
+    if (!saveProxyManifest()) std::cerr << "Failed to save proxies.json" << std::endl;
+    return ready.load();
+}
+
+std::vector<double> MediaManager::keyframeTimes(const std::string &path, FFmpegCommandBuilder::SourceVideo *video) {
+    std::string fingerprint = util::fileFingerprint(path);
+    if (fingerprint.empty()) return {};
+    {
+        std::lock_guard<std::mutex> lk(keyframeMutex_);
+        auto it = keyframes_.find(path);
+        if (it != keyframes_.end() && it->second.fingerprint == fingerprint) {
+            if (video) *video = it->second.video;
+            return it->second.times;
+        }
+    }
+
+    std::string name = fs::path(path).filename().string();
+    fs::path cacheFile = fs::path(workdir_) / "keyframes" / (util::hashString(fs::absolute(path).lexically_normal().string()) + ".json");
+    KeyframeIndex index;
+    index.fingerprint = fingerprint;
+    bool loaded = false;
+    if (std::ifstream ifs{cacheFile}) {
+        json j = json::parse(ifs, nullptr, false);
+        // version 3: times relative to the file's start_time plus the video stream's parameters
+        // (version 1 stored raw pts_time, version 2 no stream parameters)
+        if (j.is_object() && j.value("version", 1) == 3 && j.value("fingerprint", "") == fingerprint && j.contains("keyframes") && j["keyframes"].is_array()) {
+            index.times = j["keyframes"].get<std::vector<double>>();
+            const json &v = j.contains("video") && j["video"].is_object() ? j["video"] : json::object();
+            index.video.codec = v.value("codec", "");
+            index.video.profile = v.value("profile", "");
+            index.video.level = v.value("level", 0);
+            index.video.pixFmt = v.value("pix_fmt", "");
+            index.video.width = v.value("width", 0);
+            index.video.height = v.value("height", 0);
+            loaded = true;
+        }
+    }
+    if (!loaded) {
+        // packet flags only: the file is demuxed, nothing is decoded
+        Trace::Span span("media", "keyframes " + name);
+        util::ProcessOptions opts;
+        opts.captureStdout = true;
+        std::vector<std::string> argv = { ffprobePath_, "-v", "error", "-select_streams", "v:0",
+                                          "-show_entries", "packet=pts_time,flags", "-of", "csv=p=0", path };
+        auto pr = util::runProcess(argv, opts);
+        Trace::recordChild("ffprobe " + name, argv, pr);
+        if (pr.exitCode != 0) return {};
+        // pts_time is absolute, but -ss counts from the file's start_time (nonzero for most TS,
+        // some MKV and edited MP4 files); the stream parameters are what smart cut edges must match
+        double startTime = 0.0;
+        std::vector<std::string> streamArgv = { ffprobePath_, "-v", "error", "-select_streams", "v:0",
+                                                "-show_entries", "format=start_time:stream=codec_name,profile,level,pix_fmt,width,height",
+                                                "-of", "json", path };
+        auto streamPr = util::runProcess(streamArgv, opts);
+        Trace::recordChild("ffprobe " + name, streamArgv, streamPr);
+        json sj = json::parse(streamPr.out, nullptr, false);
+        if (sj.is_object() && sj.contains("format") && sj["format"].is_object()) {
+            try { startTime = std::stod(sj["format"].value("start_time", "0")); } catch (...) {}
+        }
+        if (sj.is_object() && sj.contains("streams") && sj["streams"].is_array() && !sj["streams"].empty() && sj["streams"][0].is_object()) {
+            const json &st = sj["streams"][0];
+            index.video.codec = st.value("codec_name", "");
+            index.video.profile = st.value("profile", "");
+            index.video.level = st.value("level", 0);
+            index.video.pixFmt = st.value("pix_fmt", "");
+            index.video.width = st.value("width", 0);
+            index.video.height = st.value("height", 0);
+        }
+        // one "pts_time,flags" line per packet; K marks a keyframe
+        std::istringstream lines(pr.out);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t comma = line.find(',');
+            if (comma == std::string::npos || line.find('K', comma) == std::string::npos) continue;
+            try { index.times.push_back(std::stod(line.substr(0, comma)) - startTime); } catch (...) {}
+        }
+        std::sort(index.times.begin(), index.times.end());
+        index.times.erase(std::unique(index.times.begin(), index.times.end()), index.times.end());
+        if (index.times.empty()) return {};
+
+        // temp file + rename, so a reader never sees half a file
+        std::error_code ec;
+        fs::create_directories(cacheFile.parent_path(), ec);
+        fs::path tmp = cacheFile.string() + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            json v = { {"codec", index.video.codec}, {"profile", index.video.profile}, {"level", index.video.level},
+                       {"pix_fmt", index.video.pixFmt}, {"width", index.video.width}, {"height", index.video.height} };
+            ofs << json{ {"version", 3}, {"path", path}, {"fingerprint", fingerprint}, {"start_time", startTime}, {"video", v},
+                         {"keyframes", index.times} }.dump();
+        }
+        fs::rename(tmp, cacheFile, ec);
+        if (ec) fs::remove(tmp, ec);
+    }
+
+    if (index.times.size() > 1) {
+        float interval = (float)((index.times.back() - index.times.front()) / (double)(index.times.size() - 1));
+        std::unique_lock<std::shared_mutex> lk(indexMutex_);
+        auto it = pathIndex_.find(path);
+        if (it != pathIndex_.end() && entries_[it->second].fingerprint == fingerprint && entries_[it->second].keyframeInterval != interval) {
+            MediaEntry &e = entries_[it->second];
+            e.keyframeInterval = interval;
+            auto pit = rawProbes_.find(e.path);
+            journal({ {"op", "upsert"}, {"path", e.path}, {"entry", entryToJson(e, pit != rawProbes_.end() ? pit->second : "")} });
+        }
+    }
+    if (video) *video = index.video;
+    std::lock_guard<std::mutex> lk(keyframeMutex_);
+    keyframes_[path] = index;
+    return index.times;
+}
+
 std::string MediaManager::trimClip(const std::string &inputPath, double start, double duration, const std::string &outName) {
     fs::path out = fs::path(workdir_) / outName;
+    JobShape shape;
+    MediaEntry known;
+    if (findEntry(inputPath, known)) {
+        shape.width = known.width;
+        shape.height = known.height;
+        shape.codec = known.videoCodec;
+    }
+
+    // copy the whole GOPs of an h264 source and encode only the partial ones at the edges
+    FFmpegCommandBuilder::SmartCutPlan plan;
+    std::string prefix = (out.parent_path() / (out.stem().string() + "_part")).string();
+    std::string listFile = prefix + "s.txt";
+    FFmpegCommandBuilder::SourceVideo source;
+    std::vector<double> keyframes;
+    bool smart = smartCut_ && duration >= smartCutMinSeconds_ && encodingProfile_.videoCodec == "libx264" && std::string(known.videoCodec) == "h264";
+    if (smart) keyframes = keyframeTimes(inputPath, &source);
+    if (smart && FFmpegCommandBuilder::smartCutPlan(ffmpegPath_, inputPath, start, duration, keyframes, source, smartCutMinSeconds_,
+                                                    prefix, listFile, true, out.string(), encodingProfile_, plan)) {
+        {
+            std::ofstream ofs(listFile);
+            for (auto &p : plan.parts) ofs << "file '" << fs::absolute(p).string() << "'\n";
+        }
+        // the media seconds are counted once, on the mux
+        int rc = 0;
+        for (auto &cmd : plan.partCmds) if (rc == 0) rc = runEncode(cmd, 0.0, shape);
+        if (rc == 0) rc = runEncode(plan.muxCmd, duration, shape);
+        std::error_code ec;
+        for (auto &p : plan.parts) fs::remove(p, ec);
+        fs::remove(listFile, ec);
+        if (rc != 0) return "";
+        return out.string();
+    }
+
     std::ostringstream cmd;
     cmd << util::quote(ffmpegPath_) << " -y -ss " << std::fixed << std::setprecision(3) << start
         << " -i " << util::quote(inputPath)
         << " -t " << std::fixed << std::setprecision(3) << duration
-        << " -c:v libx264 -crf 20 -preset veryfast -c:a aac -b:a 128k "
-        << util::quote(out.string());
-    int rc = util::runCommand(cmd.str());
+        << encodingProfile_.videoOptions() << encodingProfile_.audioOptions()
+        << " " << util::quote(out.string());
+    int rc = runEncode(cmd.str(), duration, shape);
     if (rc != 0) return "";
     return out.string();
 }
 
+int MediaManager::runEncode(const std::string &cmd, double mediaSeconds, const JobShape &shape) {
+    // blocks until the coordinator has a job slot and memory headroom for it
+    ResourceCoordinator::Lease lease(coordinator_, mediaSeconds, shape);
+    std::string finalCmd = lease.apply(cmd);
+    std::cout << "[cmd] " << finalCmd << std::endl;
+    util::ProcessResult r = lease.run(util::splitCommandLine(finalCmd));
+    if (r.exitCode != 0) lease.discard();
+    return r.exitCode;
+}
+
 bool MediaManager::saveIndex() {
+    {
+        std::lock_guard<std::mutex> lk(writerMutex_);
+        compactRequested_ = true;
+    }
+    writerCv_.notify_all();
+    flushIndex();
+    return lastSnapshotOk_;
+}
+
+std::string MediaManager::storedProbe(const MediaEntry &e) {
+    if (!keepRawProbes_) return "";
+    {
+        std::shared_lock<std::shared_mutex> lk(indexMutex_);
+        auto it = rawProbes_.find(e.path);
+        if (it != rawProbes_.end()) return it->second;
+    }
+    // entries restored from the binary index never loaded their probe; carry the blob over
+    MediaIndexRecordView rec;
+    if (binIndex_.isOpen() && binIndex_.find(e.path, rec) && rec.fingerprint == e.fingerprint) return std::string(rec.probe);
+    return "";
+}
+
+std::string MediaManager::keptProbe(const std::string &path) const {
+    if (!keepRawProbes_) return "";
+    std::shared_lock<std::shared_mutex> lk(indexMutex_);
+    auto it = rawProbes_.find(path);
+    return it != rawProbes_.end() ? it->second : std::string();
+}
+
+bool MediaManager::writeBinarySnapshot(const std::vector<MediaEntry> &snapshot) {
+    fs::path out = snapshotPath();
+    fs::path tmp = out.string() + ".tmp";
+    std::unique_lock<std::shared_mutex> lk(binIndexMutex_);
+    std::vector<std::string> probes;
+    probes.reserve(snapshot.size());
+    for (auto &e : snapshot) probes.push_back(storedProbe(e));
+    if (!writeMediaIndexFile(tmp.string(), snapshot, probes)) return false;
+    // a mapped file can't be replaced on Windows: unmap, rename, map the new snapshot
+    binIndex_.close();
+    try {
+        fs::rename(tmp, out);
+    } catch (...) {
+        binIndex_.open(out.string());
+        return false;
+    }
+    return binIndex_.open(out.string());
+}
+
+bool MediaManager::writeJsonSnapshot(const std::vector<MediaEntry> &snapshot, const std::string &path) {
     json j;
     j["entries"] = json::array();
-    for (auto &e : entries_) {
-        json je;
-        je["path"] = e.path;
-        je["type"] = e.type;
-        je["duration"] = e.duration;
-        je["width"] = e.width;
-        je["height"] = e.height;
-        je["fps"] = e.fps;
-        je["fingerprint"] = e.fingerprint;
-        je["normalized_path"] = e.normalized_path;
-        je["probe"] = e.rawProbe;
-        j["entries"].push_back(je);
-    }
-    fs::path out = fs::path(workdir_) / "media_index.json";
+    {
+        std::shared_lock<std::shared_mutex> lk(binIndexMutex_);
+        for (auto &e : snapshot) j["entries"].push_back(entryToJson(e, storedProbe(e)));
+    }
+    // write aside and rename over the old snapshot so readers never see a torn file
+    fs::path out = path;
+    fs::path tmp = path + ".tmp";
     try {
-        std::ofstream ofs(out);
+        std::ofstream ofs(tmp);
         ofs << std::setw(2) << j;
         ofs.close();
+        if (!ofs) return false;
+        fs::rename(tmp, out);
         return true;
     } catch (...) {
         return false;
     }
 }
 
+bool MediaManager::writeSnapshot() {
+    std::vector<MediaEntry> snapshot = entries();
+    if (binaryIndex_) return writeBinarySnapshot(snapshot);
+    return writeJsonSnapshot(snapshot, snapshotPath());
+}
+
+bool MediaManager::exportIndexJson(const std::string &path) {
+    flushIndex();
+    return writeJsonSnapshot(entries(), path);
+}
+
 std::vector<MediaEntry> MediaManager::pickRandom(const std::string &type, int count) {
+    MediaType wanted = mediaTypeFromName(type);
+    std::shared_lock<std::shared_mutex> lk(indexMutex_);
     std::vector<int> idx;
     for (int i = 0; i < (int)entries_.size(); ++i) {
-        if (type.empty() || entries_[i].type == type) idx.push_back(i);
+        if (type.empty() || entries_[i].type == wanted) idx.push_back(i);
     }
     std::vector<int> picked = util::pickRandomIndices((int)idx.size(), count);
     std::vector<MediaEntry> out;
@@ -1,42 +1,134 @@
 #pragma once
 #include <string>
+#include <cstdint>
 #include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
 #include <nlohmann/json.hpp>
+#include "Utils.h"
+#include "MediaIndexFile.h"
+#include "EncodingProfile.h"
+#include "FFmpegCommandBuilder.h"
 
 using json = nlohmann::json;
 
+class ResourceCoordinator;
+struct JobShape;
+
+enum class MediaType : uint8_t { Unknown = 0, Video, Audio, Image, Gif };
+
+// "unknown","video","audio","image","gif"
+const char *mediaTypeName(MediaType type);
+MediaType mediaTypeFromName(const std::string &name);
+
+// Codec and pixel format names repeat across thousands of entries; each distinct name is
+// stored once and the returned pointer stays valid for the life of the process ("" for empty)
+const char *internMediaName(const std::string &name);
+
+// Typed probe summary of one asset. The raw ffprobe document is not kept here
+// (see MediaManager::rawProbe).
 struct MediaEntry {
     std::string path;
-    std::string type; // "video","audio","image","gif"
-    double duration = 0.0;
-    int width = 0;
-    int height = 0;
-    double fps = 0.0;
     std::string fingerprint; // file fingerprint
     std::string normalized_path; // optional
-    json rawProbe;
+    double duration = 0.0;
+    float fps = 0.0f;
+    float keyframeInterval = 0.0f; // seconds between keyframes when known, 0 -> unknown
+    uint32_t sampleRate = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    MediaType type = MediaType::Unknown;
+    const char *videoCodec = ""; // interned names of the first video / audio stream
+    const char *audioCodec = "";
+    const char *pixelFormat = "";
 };
 
 class MediaManager {
 public:
-    MediaManager(const std::string &ffmpegPath, const std::string &workdir = "output");
+    // indexFormat: "json" (media_index.json snapshot) or "binary" (memory-mapped media_index.bin).
+    // keepRawProbes stores each file's full ffprobe output in the index as well.
+    MediaManager(const std::string &ffmpegPath, const std::string &workdir = "output", const std::string &indexFormat = "json",
+                 bool keepRawProbes = false);
+    ~MediaManager();
+
+    // Admit normalization / trim encodes through the shared CPU budget (null -> unmanaged)
+    void setCoordinator(ResourceCoordinator *coordinator) { coordinator_ = coordinator; }
+
+    // Codec settings of the copies this manager writes (normalized assets, trimmed clips);
+    // the lossless "intermediate" built-in by default
+    void setEncodingProfile(const EncodingProfile &profile) { encodingProfile_ = profile; }
+    const EncodingProfile &encodingProfile() const { return encodingProfile_; }
 
-    // Scan an assets directory and probe all files; returns number of entries
-    int scanAssets(const std::string &assetsDir);
+    // Scan an assets directory and probe all files on workerCount threads (0 -> one per core);
+    // entries are ordered by path. Returns number of entries
+    int scanAssets(const std::string &assetsDir, int workerCount = 0);
 
     // Normalize all matching media in parallel (workerCount); returns true on success
     bool normalizeAll(int workerCount = 1, int targetWidth = 1280, int targetHeight = 720, double targetFps = 30.0);
 
     // Normalize a single media file (skips if fingerprint matches existing normalized output).
-    std::string normalizeMedia(const std::string &inputPath, int targetWidth, int targetHeight, double targetFps);
+    // With a pool, a long input is split at keyframes into chunks encoded as tasks of that pool
+    // (see setChunkedNormalize); the calling thread helps run them.
+    std::string normalizeMedia(const std::string &inputPath, int targetWidth, int targetHeight, double targetFps,
+                               util::ThreadPool *pool = nullptr);
 
-    // Trim a clip: start & duration -> output path
+    // Chunked normalization: inputs at least two chunks long are encoded in up to one chunk per
+    // pool worker / job slot, each at least minChunkSeconds long (on by default, 60 s)
+    void setChunkedNormalize(bool enabled, double minChunkSeconds) { chunked_ = enabled; chunkMinSeconds_ = minChunkSeconds; }
+
+    // Where normalizeMedia writes the normalized copy of inputPath (workdir/normalized/<stem>_norm.mp4)
+    std::string normalizedPathFor(const std::string &inputPath) const;
+
+    // Low-res, low-fps copies for draft renders, in workdir/proxies/<stem>_proxy.mp4, encoded with
+    // the proxy profile ("draft" by default). A proxy is kept while its source's fingerprint and
+    // the proxy settings are unchanged (recorded in workdir/proxies/proxies.json).
+    void setProxyProfile(const EncodingProfile &profile) { proxyProfile_ = profile; }
+    std::string proxyPathFor(const std::string &inputPath) const;
+    // Returns the proxy path, or "" on failure
+    std::string makeProxy(const std::string &inputPath, int width, int height, double fps);
+    // makeProxy for every video/GIF asset on workerCount threads; returns the number of proxies ready
+    int makeProxies(int workerCount, int width, int height, double fps);
+
+    // Keyframe times (seconds from the file's start_time, as -ss counts them; ascending) of a
+    // file's first video stream, from ffprobe's packet list. Persisted per file in workdir/keyframes/ and reused while its fingerprint is
+    // unchanged; a scanned asset's keyframeInterval is filled in too. Empty if probing failed.
+    // video receives the stream's codec, profile, level, pix_fmt and size, probed alongside.
+    std::vector<double> keyframeTimes(const std::string &path, FFmpegCommandBuilder::SourceVideo *video = nullptr);
+
+    // Smart cuts in trimClip: stream-copy the whole GOPs of an h264 source when they span at
+    // least minCopySeconds (on by default)
+    void setSmartCut(bool enabled, double minCopySeconds) { smartCut_ = enabled; smartCutMinSeconds_ = minCopySeconds; }
+
+    // Trim a clip: start & duration -> output path (smart cut when possible)
     std::string trimClip(const std::string &inputPath, double start, double duration, const std::string &outName);
 
-    // Save index JSON to workdir/media_index.json
+    // Compact: write the full snapshot to workdir/media_index.json (atomic rename) and reset the journal
     bool saveIndex();
 
-    const std::vector<MediaEntry>& entries() const { return entries_; }
+    // Block until every queued index mutation has been appended to workdir/media_index.journal
+    void flushIndex();
+
+    // Write the current index (with raw probes) as JSON to path, whatever the snapshot format
+    bool exportIndexJson(const std::string &path);
+
+    // Snapshot of all entries in scan (path) order; safe while normalization workers update the index
+    std::vector<MediaEntry> entries() const;
+
+    // O(1) lookup by asset path; returns false if the path was not scanned
+    bool findEntry(const std::string &path, MediaEntry &out) const;
+
+    // Entries whose current file fingerprint equals fingerprint (e.g. moved/duplicated files)
+    std::vector<MediaEntry> findByFingerprint(const std::string &fingerprint) const;
+
+    // Full ffprobe document of an asset: the stored copy when raw probes are kept and the
+    // file is unchanged, otherwise probed again. Returns false if ffprobe fails.
+    bool rawProbe(const std::string &path, json &out);
 
     // Randomly pick up to 'count' entries of a given type
     std::vector<MediaEntry> pickRandom(const std::string &type, int count);
@@ -45,11 +137,99 @@ private:
     std::string ffmpegPath_;
     std::string ffprobePath_;
     std::string workdir_;
+    ResourceCoordinator *coordinator_ = nullptr;
+    EncodingProfile encodingProfile_ = EncodingProfile::makeIntermediate();
+    EncodingProfile proxyProfile_ = EncodingProfile::makeDraft();
+    bool smartCut_ = true;
+    double smartCutMinSeconds_ = 3.0;
+    bool chunked_ = true;
+    double chunkMinSeconds_ = 60.0;
+
+    // keyframeTimes results of this process by path, with the fingerprint they belong to
+    struct KeyframeIndex {
+        std::string fingerprint;
+        std::vector<double> times;
+        FFmpegCommandBuilder::SourceVideo video;
+    };
+    std::mutex keyframeMutex_;
+    std::unordered_map<std::string, KeyframeIndex> keyframes_;
+
+    // proxies.json: source path -> {fingerprint, settings} of its proxy (loaded on first use)
+    std::mutex proxyMutex_;
+    bool proxyManifestLoaded_ = false;
+    json proxyManifest_ = json::object();
+    void loadProxyManifestLocked();
+    bool saveProxyManifest();
+    // entries_ keeps scan order; pathIndex_/fingerprintIndex_ map into it.
+    // indexMutex_ guards all three (shared for readers, unique for writers).
     std::vector<MediaEntry> entries_;
-    json persistedIndex_; // load/save for fingerprint data
+    std::unordered_map<std::string, size_t> pathIndex_;
+    std::unordered_multimap<std::string, size_t> fingerprintIndex_;
+    mutable std::shared_mutex indexMutex_;
+
+    // Previous run's index: the mapped binary snapshot (binary format) and/or parsed JSON
+    // entries keyed by path, with journal replay applied on top. Read-only while scanning.
+    bool binaryIndex_ = false;
+    MediaIndexReader binIndex_;
+    mutable std::shared_mutex binIndexMutex_; // remapped by the writer after compaction
+    std::unordered_map<std::string, MediaEntry> persisted_;
+    std::unordered_set<std::string> persistedRemoved_;
+
+    // Raw ffprobe text by path; only filled when keepRawProbes_ (guarded by indexMutex_)
+    bool keepRawProbes_ = false;
+    std::unordered_map<std::string, std::string> rawProbes_;
+
+    std::string snapshotPath() const;
+    // Fill e from the persisted index when its fingerprint is unchanged; true if probe data was reused
+    bool restoreFromPersisted(MediaEntry &e);
+
+    void rebuildLookupsLocked();
+
+    // Index persistence: workers queue JSON-lines mutations; one writer thread appends them to
+    // media_index.journal and folds the journal into the snapshot every kCompactEvery records.
+    static constexpr size_t kCompactEvery = 512;
+    std::thread writer_;
+    std::mutex writerMutex_;
+    std::condition_variable writerCv_;
+    std::condition_variable writerIdleCv_;
+    std::deque<std::string> journalQueue_;
+    bool compactRequested_ = false;
+    bool writerStop_ = false;
+    bool writerBusy_ = false;
+    size_t journalRecords_ = 0; // touched by the writer thread only (and the constructor)
+    std::atomic<bool> lastSnapshotOk_{true};
+
+    static json entryToJson(const MediaEntry &e, const std::string &probeText = "");
+    static MediaEntry entryFromJson(const json &je);
+    void journal(const json &record);
+    void writerLoop();
+    bool writeSnapshot();
+    bool writeBinarySnapshot(const std::vector<MediaEntry> &snapshot);
+    bool writeJsonSnapshot(const std::vector<MediaEntry> &snapshot, const std::string &path);
+    // raw probe text kept for e: from this run, else the blob in the binary index (binIndexMutex_ held)
+    std::string storedProbe(const MediaEntry &e);
+    // raw probe text recorded for path during this process ("" if none or not keeping probes)
+    std::string keptProbe(const std::string &path) const;
+
+    // Walk assetsDir with one pool task per directory; returns all regular files sorted by path
+    std::vector<std::string> discoverFiles(const std::string &assetsDir, util::ThreadPool &pool);
+
+    // Run an ffmpeg command line as one coordinated job; returns its exit code
+    int runEncode(const std::string &cmd, double mediaSeconds, const JobShape &shape);
+
+    // Chunk start times for a chunked encode of `known` on pool (first 0), snapped to keyframes;
+    // fewer than two means encode in one piece
+    std::vector<double> chunkCuts(const MediaEntry &known, util::ThreadPool *pool);
+
+    // Encode inputPath to out through a ChunkedEncodePlan on pool; returns the first failing rc
+    int runChunkedEncode(const std::string &inputPath, const MediaEntry &known, const std::vector<double> &cuts,
+                         const std::string &videoFilter, const std::string &out, const JobShape &shape, util::ThreadPool &pool);
 
-    bool probeFile(const std::string &path, json &out);
-    std::string inferType(const json &probeJson, const std::string &path);
+    // Run ffprobe on path; out receives its JSON output text
+    bool probeFile(const std::string &path, std::string &out);
+    // Stream-parse ffprobe JSON text into the typed fields of e (no DOM is built)
+    static bool parseProbe(const std::string &text, MediaEntry &e);
+    static MediaType inferType(const std::string &path, MediaType firstStream);
 
     // load previously saved index if present
     void loadPersistedIndex();
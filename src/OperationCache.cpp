@@ -0,0 +1,126 @@
+#include "OperationCache.h"
+#include "Utils.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+// Hardlink when possible (same volume, no extra space); otherwise copy and keep the
+// source mtime so fingerprints of restored outputs stay stable across runs.
+static bool linkOrCopy(const fs::path &from, const fs::path &to) {
+    std::error_code ec;
+    fs::remove(to, ec);
+    fs::create_hard_link(from, to, ec);
+    if (!ec) return true;
+    ec.clear();
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+    if (ec) return false;
+    fs::last_write_time(to, fs::last_write_time(from, ec), ec);
+    return true;
+}
+
+OperationCache::OperationCache(const std::string &dir, uint64_t maxBytes)
+    : dir_(dir), maxBytes_(maxBytes) {
+    util::ensureDir(dir_);
+    loadIndex();
+}
+
+void OperationCache::loadIndex() {
+    fs::path idxp = fs::path(dir_) / "cache_index.json";
+    if (!fs::exists(idxp)) return;
+    try {
+        std::ifstream ifs(idxp);
+        json j;
+        ifs >> j;
+        clock_ = j.value("clock", (int64_t)0);
+        for (auto &it : j["entries"].items()) {
+            Entry e;
+            e.file = it.value().value("file", "");
+            e.size = it.value().value("size", (uint64_t)0);
+            e.lastUsed = it.value().value("last_used", (int64_t)0);
+            // drop entries whose file vanished from under us
+            if (e.file.empty() || !fs::exists(fs::path(dir_) / e.file)) continue;
+            totalBytes_ += e.size;
+            entries_[it.key()] = e;
+        }
+    } catch (...) {}
+}
+
+bool OperationCache::saveIndex() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    json j;
+    j["clock"] = clock_;
+    j["entries"] = json::object();
+    for (auto &kv : entries_) {
+        j["entries"][kv.first] = { {"file", kv.second.file}, {"size", kv.second.size}, {"last_used", kv.second.lastUsed} };
+    }
+    // write aside and rename into place, so a crash mid-write leaves the old index intact
+    fs::path path = fs::path(dir_) / "cache_index.json";
+    fs::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs) return false;
+        ofs << std::setw(2) << j;
+        if (!ofs) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (!ec) return true;
+    fs::remove(tmp, ec);
+    return false;
+}
+
+bool OperationCache::restore(const std::string &key, const std::string &outputPath) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    fs::path cached = fs::path(dir_) / it->second.file;
+    if (!fs::exists(cached) || !linkOrCopy(cached, outputPath)) {
+        totalBytes_ -= std::min(totalBytes_, it->second.size);
+        entries_.erase(it);
+        return false;
+    }
+    it->second.lastUsed = ++clock_;
+    return true;
+}
+
+bool OperationCache::store(const std::string &key, const std::string &outputPath) {
+    std::error_code ec;
+    uint64_t size = fs::file_size(outputPath, ec);
+    if (ec) return false;
+    std::string file = key + fs::path(outputPath).extension().string();
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (!linkOrCopy(outputPath, fs::path(dir_) / file)) return false;
+    auto it = entries_.find(key);
+    if (it != entries_.end()) totalBytes_ -= std::min(totalBytes_, it->second.size);
+    Entry &e = entries_[key];
+    e.file = file;
+    e.size = size;
+    e.lastUsed = ++clock_;
+    totalBytes_ += size;
+    evictLocked();
+    return true;
+}
+
+void OperationCache::evictLocked() {
+    if (totalBytes_ <= maxBytes_) return;
+    std::vector<std::pair<int64_t, std::string>> order;
+    for (auto &kv : entries_) order.emplace_back(kv.second.lastUsed, kv.first);
+    std::sort(order.begin(), order.end());
+    for (auto &o : order) {
+        if (totalBytes_ <= maxBytes_) break;
+        auto it = entries_.find(o.second);
+        std::error_code ec;
+        fs::remove(fs::path(dir_) / it->second.file, ec);
+        totalBytes_ -= std::min(totalBytes_, it->second.size);
+        std::cout << "[cache] evicted " << it->second.file << std::endl;
+        entries_.erase(it);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+// Content-addressed store of operation outputs under <workdir>/cache.
+// Keys are computed by the caller (resolved commands + input fingerprints);
+// entries are evicted least-recently-used once the cache exceeds maxBytes.
+class OperationCache {
+public:
+    OperationCache(const std::string &dir, uint64_t maxBytes);
+
+    // Place the cached result for key at outputPath (hardlink, copy fallback); true on hit
+    bool restore(const std::string &key, const std::string &outputPath);
+
+    // Record outputPath as the result for key, then evict over the size limit
+    bool store(const std::string &key, const std::string &outputPath);
+
+    // Persist the LRU bookkeeping to dir/cache_index.json
+    bool saveIndex();
+
+private:
+    struct Entry {
+        std::string file;
+        uint64_t size = 0;
+        int64_t lastUsed = 0;
+    };
+
+    std::string dir_;
+    uint64_t maxBytes_;
+    uint64_t totalBytes_ = 0;
+    int64_t clock_ = 0; // logical LRU clock, persisted with the index
+    std::map<std::string, Entry> entries_;
+    std::mutex mtx_;
+
+    void loadIndex();
+    void evictLocked();
+};
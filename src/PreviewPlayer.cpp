@@ -1,5 +1,7 @@
 #include "PreviewPlayer.h"
+#include "Process.h"
 #include <iostream>
+#include <vector>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -13,6 +15,11 @@ PreviewPlayer::~PreviewPlayer() {
     stop();
 }
 
+// A playlist that is still being written: play it from the first segment, not the live edge
+static bool isPlaylist(const std::string &file) {
+    return file.size() >= 5 && file.compare(file.size() - 5, 5, ".m3u8") == 0;
+}
+
 bool PreviewPlayer::play(const std::string &file, bool loop) {
 #ifdef _WIN32
     // If already running, stop first
@@ -20,6 +27,7 @@ bool PreviewPlayer::play(const std::string &file, bool loop) {
 
     std::string cmd = "\"" + ffplayPath_ + "\" -autoexit -nodisp ";
     if (loop) cmd += "-loop 0 ";
+    if (isPlaylist(file)) cmd += "-live_start_index 0 ";
     cmd += "\"" + file + "\"";
 
     STARTUPINFOA si;
@@ -47,12 +55,18 @@ bool PreviewPlayer::play(const std::string &file, bool loop) {
     processHandle_ = pi.hProcess;
     return true;
 #else
-    // Non-Windows: simply spawn system command (not used for target Windows 8.1)
-    std::string cmd = "\"" + ffplayPath_ + "\" -autoexit -nodisp ";
-    if (loop) cmd += "-loop 0 ";
-    cmd += "\"" + file + "\"";
-    int r = std::system(cmd.c_str());
-    return (r == 0);
+    if (process_) stop();
+    std::vector<std::string> argv = { ffplayPath_, "-autoexit", "-nodisp" };
+    if (loop) { argv.push_back("-loop"); argv.push_back("0"); }
+    if (isPlaylist(file)) { argv.push_back("-live_start_index"); argv.push_back("0"); }
+    argv.push_back(file);
+    process_ = util::Process::spawn(argv);
+    if (!process_->running()) {
+        std::cerr << "Failed to start ffplay: " << process_->wait().err << std::endl;
+        process_.reset();
+        return false;
+    }
+    return true;
 #endif
 }
 
@@ -71,8 +85,10 @@ bool PreviewPlayer::stop() {
     processHandle_ = nullptr;
     return true;
 #else
-    // Not implemented for non-Windows in this simple wrapper.
-    return false;
+    if (!process_) return false;
+    bool killed = process_->kill();
+    process_.reset();
+    return killed;
 #endif
 }
 
@@ -85,6 +101,6 @@ bool PreviewPlayer::isRunning() const {
     }
     return false;
 #else
-    return false;
+    return process_ && process_->running();
 #endif
 }
\ No newline at end of file
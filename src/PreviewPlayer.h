@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <memory>
+
+namespace util { class Process; }
 
 class PreviewPlayer {
 public:
@@ -20,4 +23,5 @@ public:
 private:
     std::string ffplayPath_;
     void *processHandle_; // opaque handle (Windows HANDLE)
+    std::unique_ptr<util::Process> process_; // non-Windows child
 };
\ No newline at end of file
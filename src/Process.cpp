@@ -0,0 +1,498 @@
+#include "Process.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+extern char **environ;
+#endif
+
+namespace util {
+
+using Clock = std::chrono::steady_clock;
+
+// Pipes are created and handed to the child under this lock so a concurrently
+// spawned sibling never inherits another child's write end (which would keep
+// that pipe open and stall its reader).
+static std::mutex spawnMutex;
+
+std::vector<std::string> splitCommandLine(const std::string &cmd) {
+    std::vector<std::string> out;
+    std::string cur;
+    bool inQuotes = false;
+    bool have = false;
+    for (size_t i = 0; i < cmd.size(); ++i) {
+        char c = cmd[i];
+        if (inQuotes) {
+            if (c == '\\' && i + 1 < cmd.size() && cmd[i + 1] == '"') {
+                cur += '"';
+                ++i;
+            } else if (c == '"') {
+                inQuotes = false;
+            } else {
+                cur += c;
+            }
+        } else if (c == '"') {
+            inQuotes = true;
+            have = true;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (have) out.push_back(cur);
+            cur.clear();
+            have = false;
+        } else {
+            cur += c;
+            have = true;
+        }
+    }
+    if (have) out.push_back(cur);
+    return out;
+}
+
+struct Process::Impl {
+    ProcessOptions opts;
+    ProcessResult result;
+    Clock::time_point started;
+    bool reaped = false;
+#ifdef _WIN32
+    HANDLE process = nullptr;
+    DWORD pid = 0;
+    std::thread outReader;
+    std::thread errReader;
+#else
+    pid_t pid = -1;
+    int outFd = -1;
+    int errFd = -1;
+#endif
+};
+
+Process::Process() : impl_(new Impl()) {}
+
+Process::~Process() {
+    if (running()) kill();
+    wait();
+    delete impl_;
+}
+
+#ifdef _WIN32
+
+// Quote one argument following the MSVCRT command line parsing rules
+static std::string quoteWindowsArg(const std::string &a) {
+    if (!a.empty() && a.find_first_of(" \t\n\v\"") == std::string::npos) return a;
+    std::string out = "\"";
+    for (size_t i = 0; ; ++i) {
+        size_t backslashes = 0;
+        while (i < a.size() && a[i] == '\\') { ++i; ++backslashes; }
+        if (i == a.size()) {
+            out.append(backslashes * 2, '\\');
+            break;
+        } else if (a[i] == '"') {
+            out.append(backslashes * 2 + 1, '\\');
+            out += '"';
+        } else {
+            out.append(backslashes, '\\');
+            out += a[i];
+        }
+    }
+    out += '"';
+    return out;
+}
+
+static void readAll(HANDLE h, std::string *dst) {
+    char buf[65536];
+    DWORD n = 0;
+    while (ReadFile(h, buf, sizeof(buf), &n, nullptr) && n > 0) dst->append(buf, n);
+    CloseHandle(h);
+}
+
+static double fileTimeSeconds(const FILETIME &ft) {
+    ULARGE_INTEGER v;
+    v.LowPart = ft.dwLowDateTime;
+    v.HighPart = ft.dwHighDateTime;
+    return (double)v.QuadPart / 1e7; // 100ns units
+}
+
+std::unique_ptr<Process> Process::spawn(const std::vector<std::string> &argv, const ProcessOptions &opts) {
+    std::unique_ptr<Process> p(new Process());
+    Impl *im = p->impl_;
+    im->opts = opts;
+    im->started = Clock::now();
+    if (argv.empty()) {
+        im->reaped = true;
+        return p;
+    }
+
+    std::string cmdline;
+    for (size_t i = 0; i < argv.size(); ++i) {
+        if (i) cmdline += ' ';
+        cmdline += quoteWindowsArg(argv[i]);
+    }
+    std::vector<char> cmdbuf(cmdline.begin(), cmdline.end());
+    cmdbuf.push_back('\0');
+
+    SECURITY_ATTRIBUTES sa;
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = nullptr;
+    sa.bInheritHandle = TRUE;
+
+    std::lock_guard<std::mutex> lk(spawnMutex);
+    HANDLE outRead = nullptr, outWrite = nullptr, errRead = nullptr, errWrite = nullptr, nul = nullptr;
+    if (opts.captureStdout && CreatePipe(&outRead, &outWrite, &sa, 0)) {
+        SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+    }
+    if (opts.captureStderr && CreatePipe(&errRead, &errWrite, &sa, 0)) {
+        SetHandleInformation(errRead, HANDLE_FLAG_INHERIT, 0);
+    }
+    if (!opts.inheritStdin) {
+        nul = CreateFileA("NUL", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, nullptr);
+    }
+
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = nul ? nul : GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = outWrite ? outWrite : GetStdHandle(STD_OUTPUT_HANDLE);
+    si.hStdError = errWrite ? errWrite : GetStdHandle(STD_ERROR_HANDLE);
+    ZeroMemory(&pi, sizeof(pi));
+
+    BOOL ok = CreateProcessA(nullptr, cmdbuf.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &pi);
+    if (outWrite) CloseHandle(outWrite);
+    if (errWrite) CloseHandle(errWrite);
+    if (nul) CloseHandle(nul);
+    if (!ok) {
+        if (outRead) CloseHandle(outRead);
+        if (errRead) CloseHandle(errRead);
+        im->result.err = "CreateProcess error " + std::to_string(GetLastError());
+        im->reaped = true;
+        return p;
+    }
+    CloseHandle(pi.hThread);
+    im->process = pi.hProcess;
+    im->pid = pi.dwProcessId;
+    im->result.started = true;
+    // one reader per pipe so a full stderr can't block a stdout read (and vice versa)
+    if (outRead) im->outReader = std::thread(readAll, outRead, &im->result.out);
+    if (errRead) im->errReader = std::thread(readAll, errRead, &im->result.err);
+    return p;
+}
+
+long Process::pid() const {
+    return (long)impl_->pid;
+}
+
+bool Process::running() {
+    if (impl_->reaped || !impl_->process) return false;
+    return WaitForSingleObject(impl_->process, 0) == WAIT_TIMEOUT;
+}
+
+bool Process::kill() {
+    if (!running()) return false;
+    return TerminateProcess(impl_->process, 1) != 0;
+}
+
+const ProcessResult &Process::wait() {
+    Impl *im = impl_;
+    if (im->reaped) return im->result;
+    bool hasDeadline = im->opts.timeoutSeconds > 0.0;
+    auto deadline = im->started + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(im->opts.timeoutSeconds));
+    while (true) {
+        // wake up now and then to look at the cancellation token
+        DWORD waitMs = INFINITE;
+        if (hasDeadline) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            waitMs = (DWORD)std::max<long long>(0, left);
+        }
+        if (im->opts.cancel) waitMs = std::min<DWORD>(waitMs, 100);
+        if (WaitForSingleObject(im->process, waitMs) != WAIT_TIMEOUT) break;
+        bool cancelled = im->opts.cancel && im->opts.cancel->cancelled();
+        if (!cancelled && !(hasDeadline && Clock::now() >= deadline)) continue;
+        TerminateProcess(im->process, 1);
+        if (cancelled) im->result.cancelled = true;
+        else im->result.timedOut = true;
+        WaitForSingleObject(im->process, INFINITE);
+        break;
+    }
+    if (im->outReader.joinable()) im->outReader.join();
+    if (im->errReader.joinable()) im->errReader.join();
+
+    DWORD code = 1;
+    GetExitCodeProcess(im->process, &code);
+    im->result.exitCode = (int)code;
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(im->process, &created, &exited, &kernel, &user)) {
+        im->result.userSeconds = fileTimeSeconds(user);
+        im->result.systemSeconds = fileTimeSeconds(kernel);
+    }
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(im->process, &pmc, sizeof(pmc))) {
+        im->result.maxRssKb = (long)(pmc.PeakWorkingSetSize / 1024);
+    }
+    IO_COUNTERS io;
+    if (GetProcessIoCounters(im->process, &io)) {
+        im->result.readBytes = io.ReadTransferCount;
+        im->result.writeBytes = io.WriteTransferCount;
+    }
+    CloseHandle(im->process);
+    im->process = nullptr;
+    im->reaped = true;
+    im->result.wallSeconds = std::chrono::duration<double>(Clock::now() - im->started).count();
+    return im->result;
+}
+
+#else
+
+static bool makePipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+std::unique_ptr<Process> Process::spawn(const std::vector<std::string> &argv, const ProcessOptions &opts) {
+    std::unique_ptr<Process> p(new Process());
+    Impl *im = p->impl_;
+    im->opts = opts;
+    im->started = Clock::now();
+    if (argv.empty()) {
+        im->reaped = true;
+        return p;
+    }
+
+    std::vector<char *> args;
+    for (auto &a : argv) args.push_back(const_cast<char *>(a.c_str()));
+    args.push_back(nullptr);
+
+    std::lock_guard<std::mutex> lk(spawnMutex);
+    int outPipe[2] = { -1, -1 };
+    int errPipe[2] = { -1, -1 };
+    if (opts.captureStdout && !makePipe(outPipe)) outPipe[0] = outPipe[1] = -1;
+    if (opts.captureStderr && !makePipe(errPipe)) errPipe[0] = errPipe[1] = -1;
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    if (!opts.inheritStdin) posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    // dup2 clears FD_CLOEXEC on the target, the originals close on exec
+    if (outPipe[1] >= 0) posix_spawn_file_actions_adddup2(&fa, outPipe[1], 1);
+    if (errPipe[1] >= 0) posix_spawn_file_actions_adddup2(&fa, errPipe[1], 2);
+
+    pid_t pid = -1;
+    int rc = posix_spawnp(&pid, args[0], &fa, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (outPipe[1] >= 0) close(outPipe[1]);
+    if (errPipe[1] >= 0) close(errPipe[1]);
+    if (rc != 0) {
+        if (outPipe[0] >= 0) close(outPipe[0]);
+        if (errPipe[0] >= 0) close(errPipe[0]);
+        im->result.err = std::string("spawn failed: ") + std::strerror(rc);
+        im->reaped = true;
+        return p;
+    }
+    im->pid = pid;
+    im->outFd = outPipe[0];
+    im->errFd = errPipe[0];
+    im->result.started = true;
+    return p;
+}
+
+long Process::pid() const {
+    return (long)impl_->pid;
+}
+
+static void fillFromStatus(ProcessResult &r, int status, const struct rusage &ru) {
+    if (WIFEXITED(status)) {
+        r.exitCode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        r.signal = WTERMSIG(status);
+        r.exitCode = 128 + r.signal;
+    }
+    r.userSeconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    r.systemSeconds = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    r.maxRssKb = (long)(ru.ru_maxrss / 1024); // bytes on macOS
+#else
+    r.maxRssKb = (long)ru.ru_maxrss;
+#endif
+}
+
+// rchar/wchar of a not yet reaped child (Linux only)
+static void readIoCounters(pid_t pid, ProcessResult &r) {
+#ifdef __linux__
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%ld/io", (long)pid);
+    FILE *f = std::fopen(path, "r");
+    if (!f) return;
+    char line[128];
+    while (std::fgets(line, sizeof(line), f)) {
+        if (std::strncmp(line, "rchar:", 6) == 0) r.readBytes = std::strtoull(line + 6, nullptr, 10);
+        else if (std::strncmp(line, "wchar:", 6) == 0) r.writeBytes = std::strtoull(line + 6, nullptr, 10);
+    }
+    std::fclose(f);
+#else
+    (void)pid;
+    (void)r;
+#endif
+}
+
+bool Process::running() {
+    Impl *im = impl_;
+    if (im->reaped || im->pid <= 0) return false;
+    int status = 0;
+    struct rusage ru;
+    std::memset(&ru, 0, sizeof(ru));
+    pid_t r = wait4(im->pid, &status, WNOHANG, &ru);
+    if (r == 0) return true;
+    if (r == im->pid) {
+        fillFromStatus(im->result, status, ru);
+        im->result.wallSeconds = std::chrono::duration<double>(Clock::now() - im->started).count();
+    }
+    im->reaped = true;
+    return false;
+}
+
+bool Process::kill() {
+    if (!running()) return false;
+    return ::kill(impl_->pid, SIGKILL) == 0;
+}
+
+const ProcessResult &Process::wait() {
+    Impl *im = impl_;
+    bool hasDeadline = im->opts.timeoutSeconds > 0.0;
+    auto deadline = im->started + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(im->opts.timeoutSeconds));
+
+    auto expire = [&]() {
+        if (!im->reaped && im->pid > 0) ::kill(im->pid, SIGKILL);
+        im->result.timedOut = true;
+        hasDeadline = false;
+    };
+    // with a cancellation token the waits below wake up now and then to look at it
+    bool watchCancel = im->opts.cancel != nullptr;
+    auto checkCancel = [&]() {
+        if (!watchCancel || !im->opts.cancel->cancelled()) return;
+        if (!im->reaped && im->pid > 0) ::kill(im->pid, SIGKILL);
+        im->result.cancelled = true;
+        watchCancel = false;
+    };
+
+    // Drain both pipes until the child closes them
+    char buf[65536];
+    while (im->outFd >= 0 || im->errFd >= 0) {
+        struct pollfd fds[2];
+        std::string *dst[2];
+        int *fdp[2];
+        int n = 0;
+        if (im->outFd >= 0) { fds[n].fd = im->outFd; fds[n].events = POLLIN; dst[n] = &im->result.out; fdp[n] = &im->outFd; ++n; }
+        if (im->errFd >= 0) { fds[n].fd = im->errFd; fds[n].events = POLLIN; dst[n] = &im->result.err; fdp[n] = &im->errFd; ++n; }
+        int waitMs = -1;
+        if (hasDeadline) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (left <= 0) { expire(); continue; }
+            waitMs = (int)left;
+        }
+        checkCancel();
+        if (watchCancel) waitMs = waitMs < 0 ? 100 : std::min(waitMs, 100);
+        int r = poll(fds, n, waitMs);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t got = read(fds[i].fd, buf, sizeof(buf));
+            if (got > 0) {
+                dst[i]->append(buf, (size_t)got);
+            } else if (got == 0 || errno != EINTR) {
+                close(*fdp[i]);
+                *fdp[i] = -1;
+            }
+        }
+    }
+
+    if (!im->reaped && im->pid > 0) {
+        // Wait for the exit without reaping, so the zombie's I/O counters can still be read
+        while (true) {
+            siginfo_t si;
+            std::memset(&si, 0, sizeof(si));
+            int w = waitid(P_PID, (id_t)im->pid, &si, WEXITED | WNOWAIT | (hasDeadline || watchCancel ? WNOHANG : 0));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 || si.si_pid != 0) break;
+            checkCancel();
+            if (hasDeadline && Clock::now() >= deadline) {
+                expire();
+                continue;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        readIoCounters(im->pid, im->result);
+
+        int status = 0;
+        struct rusage ru;
+        std::memset(&ru, 0, sizeof(ru));
+        pid_t r = 0;
+        do {
+            r = wait4(im->pid, &status, 0, &ru);
+        } while (r < 0 && errno == EINTR);
+        if (r == im->pid) fillFromStatus(im->result, status, ru);
+        im->reaped = true;
+        im->result.wallSeconds = std::chrono::duration<double>(Clock::now() - im->started).count();
+    }
+    return im->result;
+}
+
+#endif
+
+ProcessResult runProcess(const std::vector<std::string> &argv, const ProcessOptions &opts) {
+    auto p = Process::spawn(argv, opts);
+    return p->wait();
+}
+
+long processResidentKb(long pid) {
+    if (pid <= 0) return 0;
+#ifdef _WIN32
+    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!h) return 0;
+    PROCESS_MEMORY_COUNTERS pmc;
+    long kb = 0;
+    if (GetProcessMemoryInfo(h, &pmc, sizeof(pmc))) kb = (long)(pmc.WorkingSetSize / 1024);
+    CloseHandle(h);
+    return kb;
+#elif defined(__linux__)
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%ld/status", pid);
+    FILE *f = std::fopen(path, "r");
+    if (!f) return 0;
+    char line[256];
+    long kb = 0;
+    while (std::fgets(line, sizeof(line), f)) {
+        if (std::strncmp(line, "VmRSS:", 6) == 0) {
+            kb = std::strtol(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    std::fclose(f);
+    return kb;
+#else
+    return 0;
+#endif
+}
+
+} // namespace util
@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace util {
+
+class CancellationToken;
+
+// Split a command line produced by the command builders into argv. Follows the
+// quoting of quote()/FFmpegCommandBuilder::quote: whitespace separates arguments,
+// double quotes group, and \" inside quotes is a literal quote.
+std::vector<std::string> splitCommandLine(const std::string &cmd);
+
+struct ProcessOptions {
+    bool captureStdout = false;  // collect stdout into ProcessResult::out
+    bool captureStderr = false;  // collect stderr into ProcessResult::err
+    bool inheritStdin = false;   // otherwise stdin is the null device (ffmpeg won't eat console input)
+    double timeoutSeconds = 0.0; // kill the child after this long; 0 -> no timeout
+    const CancellationToken *cancel = nullptr; // kill the child once cancelled (must outlive wait())
+};
+
+struct ProcessResult {
+    bool started = false;      // false if the executable could not be launched
+    int exitCode = -1;         // exit status; 128+signal when killed by a signal
+    int signal = 0;            // terminating signal (POSIX only)
+    bool timedOut = false;
+    bool cancelled = false;    // killed because opts.cancel was cancelled
+    double wallSeconds = 0.0;
+    double userSeconds = 0.0;  // child CPU time from wait4 rusage / GetProcessTimes
+    double systemSeconds = 0.0;
+    long maxRssKb = 0;         // peak resident set size
+    uint64_t readBytes = 0;    // bytes read / written through syscalls (/proc/<pid>/io, GetProcessIoCounters)
+    uint64_t writeBytes = 0;
+    std::string out;
+    std::string err;
+};
+
+// A child process launched without a shell (posix_spawn / CreateProcess).
+class Process {
+public:
+    // Launch argv (argv[0] is searched on PATH). Never throws; a failed launch
+    // yields a handle whose wait() returns started == false.
+    static std::unique_ptr<Process> spawn(const std::vector<std::string> &argv,
+                                          const ProcessOptions &opts = ProcessOptions());
+
+    // Kills and reaps a child that is still running
+    ~Process();
+
+    long pid() const;
+
+    // Non-blocking check whether the child is still alive
+    bool running();
+
+    // Drain captured pipes, enforce the timeout and reap the child; repeat calls return the same result
+    const ProcessResult &wait();
+
+    // Forcefully terminate the child; returns true if it was still running
+    bool kill();
+
+private:
+    Process();
+    Process(const Process &) = delete;
+    Process &operator=(const Process &) = delete;
+
+    struct Impl;
+    Impl *impl_;
+};
+
+// Current resident set size of a running process in KiB (0 if unknown or gone). Reads
+// /proc/<pid>/status on Linux and the working set on Windows; other systems report 0.
+long processResidentKb(long pid);
+
+// spawn + wait
+ProcessResult runProcess(const std::vector<std::string> &argv,
+                         const ProcessOptions &opts = ProcessOptions());
+
+} // namespace util
@@ -1,16 +1,80 @@
 #include "RemixRuleEngine.h"
 #include "FFmpegCommandBuilder.h"
 #include "PreviewPlayer.h"
+#include "OperationCache.h"
+#include "Utils.h"
+#include "Process.h"
+#include "ResourceCoordinator.h"
+#include "Trace.h"
+#include "MediaManager.h"
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <iostream>
 #include <random>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
+// While set, runCommand records commands here instead of executing them; used to plan
+// an op's fully resolved commands for its cache key.
+static thread_local std::vector<std::string> *tlPlan = nullptr;
+
+// Cancellation of the op this thread is running: runCommand kills its ffmpeg child once it
+// is cancelled (a stream reader whose producer failed).
+static thread_local const util::CancellationToken *tlCancel = nullptr;
+
+// Each ffmpeg is multi-threaded itself; same heuristic as normalization: max(1, cores/2)
+static int defaultWorkerCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0) cores = 2;
+    return (int)std::max(1u, cores / 2);
+}
+
+// Timestamp ranges of a bleep op; false when the spec has no ranges array
+static bool bleepRanges(const json &spec, std::vector<std::pair<double,double>> &ranges) {
+    if (!spec.contains("ranges") || !spec["ranges"].is_array()) return false;
+    for (auto &r : spec["ranges"]) {
+        double s = r.value("start", 0.0);
+        double e = r.value("end", s + 0.5);
+        ranges.emplace_back(s, e);
+    }
+    return true;
+}
+
+// The fused-chain stage of a pitch/bleep/overlay op; false for ops that cannot be fused
+static bool chainStageFromSpec(const json &spec, FFmpegCommandBuilder::ChainStage &st) {
+    if (!spec.is_object() || !spec.contains("input") || !spec["input"].is_string()) return false;
+    std::string type = spec.value("type", "");
+    st = FFmpegCommandBuilder::ChainStage();
+    if (type == "pitch") {
+        st.kind = FFmpegCommandBuilder::ChainStage::Kind::Pitch;
+        st.semitones = spec.value("semitones", 0.0);
+        return true;
+    } else if (type == "bleep") {
+        st.kind = FFmpegCommandBuilder::ChainStage::Kind::Bleep;
+        return bleepRanges(spec, st.ranges) && !st.ranges.empty();
+    } else if (type == "overlay") {
+        if (!spec.contains("overlay") || !spec["overlay"].is_string()) return false;
+        st.kind = FFmpegCommandBuilder::ChainStage::Kind::Overlay;
+        st.overlayInput = spec["overlay"].get<std::string>();
+        st.enableStart = spec.value("start", 0.0);
+        st.enableEnd = spec.value("end", 9999.0);
+        st.overlayScale = spec.value("overlay_scale", 0.2);
+        st.position = spec.value("position", "topright");
+        return true;
+    }
+    return false;
+}
+
 RemixRuleEngine::RemixRuleEngine(const std::string &ffmpegPath, const std::string &workdir)
     : ffmpegPath_(ffmpegPath), workdir_(workdir) {
     if (!fs::exists(workdir_)) {
@@ -20,89 +84,270 @@ RemixRuleEngine::RemixRuleEngine(const std::string &ffmpegPath, const std::strin
 
 RemixRuleEngine::~RemixRuleEngine() = default;
 
-int RemixRuleEngine::runCommand(const std::string &cmd, bool dryRun) {
-    std::cout << "[exec] " << cmd << std::endl;
-    if (dryRun) return 0;
-    int r = std::system(cmd.c_str());
-    if (r != 0) {
-        std::cerr << "Command failed with code: " << r << std::endl;
+int RemixRuleEngine::runCommand(const std::string &opCmd, bool dryRun, double outputSeconds) {
+    std::string cmd = FFmpegCommandBuilder::playlistIoCmd(opCmd, segmentSeconds_);
+    if (tlPlan) {
+        std::lock_guard<std::mutex> lk(logMutex_);
+        tlPlan->push_back(cmd);
+        return 0;
+    }
+    if (dryRun) {
+        std::lock_guard<std::mutex> lk(logMutex_);
+        std::cout << "[exec] " << cmd << std::endl;
+        return 0;
+    }
+    if (tlCancel && tlCancel->cancelled()) return 1;
+    // waits here while the machine-wide job limit or memory limit is reached
+    double mediaSeconds = 0.0;
+    JobShape shape;
+    if (coordinator_) describeCommand(cmd, outputSeconds, mediaSeconds, shape);
+    ResourceCoordinator::Lease lease(coordinator_, mediaSeconds, shape);
+    std::string finalCmd = lease.apply(cmd);
+    {
+        std::lock_guard<std::mutex> lk(logMutex_);
+        std::cout << "[exec] " << finalCmd << std::endl;
+    }
+    util::ProcessOptions opts;
+    opts.timeoutSeconds = commandTimeout_;
+    opts.cancel = tlCancel;
+    util::ProcessResult pr = lease.run(util::splitCommandLine(finalCmd), opts);
+    if (pr.exitCode != 0) {
+        lease.discard();
+        std::lock_guard<std::mutex> lk(logMutex_);
+        if (!pr.started) std::cerr << "Command could not be started: " << pr.err << std::endl;
+        else if (pr.cancelled) std::cerr << "Command cancelled" << std::endl;
+        else if (pr.timedOut) std::cerr << "Command timed out after " << commandTimeout_ << "s" << std::endl;
+        else std::cerr << "Command failed with code: " << pr.exitCode << std::endl;
     }
-    return r;
+    return pr.exitCode;
 }
 
-int RemixRuleEngine::processStutter(const std::string &input, double start, double duration, int repeats, const std::string &output, bool dryRun) {
-    fs::path frag = fs::path(workdir_) / "stutter_fragment.mp4";
-    auto cmd1 = FFmpegCommandBuilder::extractFragmentCmd(ffmpegPath_, input, start, duration, frag.string(), false, "libx264");
-    if (runCommand(cmd1, dryRun) != 0) return 1;
+RemixRuleEngine::InputInfo RemixRuleEngine::inputInfo(const std::string &path) {
+    {
+        std::lock_guard<std::mutex> lk(inputInfoMutex_);
+        auto it = inputInfo_.find(path);
+        if (it != inputInfo_.end()) return it->second;
+    }
+    InputInfo info;
+    util::ProcessOptions opts;
+    opts.captureStdout = true;
+    std::vector<std::string> argv = { util::toolPath(ffmpegPath_, "ffprobe"), "-v", "error", "-select_streams", "v:0",
+                                      "-show_entries", "format=duration:stream=codec_name,width,height",
+                                      "-of", "json", path };
+    auto pr = util::runProcess(argv, opts);
+    Trace::recordChild("ffprobe " + fs::path(path).filename().string(), argv, pr);
+    // a concat list or missing file just stays unmeasured
+    json j = json::parse(pr.out, nullptr, false);
+    if (pr.exitCode == 0 && j.is_object()) {
+        try {
+            if (j.contains("format") && j["format"].contains("duration")) info.duration = std::stod(j["format"]["duration"].get<std::string>());
+            if (j.contains("streams") && !j["streams"].empty()) {
+                const json &v = j["streams"][0];
+                info.width = v.value("width", 0);
+                info.height = v.value("height", 0);
+                info.codec = v.value("codec_name", "");
+            }
+        } catch (...) {}
+    }
+    std::lock_guard<std::mutex> lk(inputInfoMutex_);
+    inputInfo_[path] = info;
+    return info;
+}
 
-    fs::path listFile = fs::path(workdir_) / "stutter_list.txt";
-    std::ofstream ofs(listFile);
-    for (int i = 0; i < repeats; ++i) {
-        ofs << "file '" << fs::absolute(frag).string() << "'\n";
+void RemixRuleEngine::describeCommand(const std::string &cmd, double outputSeconds, double &mediaSeconds, JobShape &shape) {
+    std::vector<std::string> argv = util::splitCommandLine(cmd);
+    double limit = 0.0;
+    bool first = true;
+    mediaSeconds = 0.0;
+    shape.videoInputs = 0;
+    for (size_t i = 1; i + 1 < argv.size(); ++i) {
+        if (argv[i] == "-t") {
+            try { limit = std::stod(argv[i + 1]); } catch (...) {}
+        } else if (argv[i] == "-i") {
+            InputInfo info = inputInfo(argv[i + 1]);
+            if (first) mediaSeconds = info.duration;
+            first = false;
+            if (info.width > 0) {
+                ++shape.videoInputs;
+                if (info.width * info.height > shape.width * shape.height) {
+                    shape.width = info.width;
+                    shape.height = info.height;
+                    shape.codec = info.codec;
+                }
+            }
+        }
     }
-    ofs.close();
+    if (outputSeconds > 0.0) mediaSeconds = outputSeconds;
+    else if (limit > 0.0) mediaSeconds = limit;
+    shape.videoInputs = std::max(1, shape.videoInputs);
+}
+
+std::string RemixRuleEngine::tempPath(size_t opIndex, const std::string &name) const {
+    return (fs::path(workdir_) / (tempPrefix_ + "op" + std::to_string(opIndex) + "_" + name)).string();
+}
 
-    auto cmd2 = FFmpegCommandBuilder::makeRepeatConcatCmd(ffmpegPath_, frag.string(), repeats, output, listFile.string());
-    return runCommand(cmd2, dryRun);
+int RemixRuleEngine::processStutter(const std::string &input, double start, double duration, int repeats, bool inPlace, const std::string &output, const EncodingProfile &profile, bool dryRun) {
+    // Single encode straight from the source: no fragment file, no concat list
+    double srcDuration = 0.0;
+    bool hasAudio = true;
+    probeInput(input, srcDuration, hasAudio);
+    auto cmd = inPlace
+        ? FFmpegCommandBuilder::stutterInPlaceCmd(ffmpegPath_, input, start, duration, repeats, hasAudio, output, profile)
+        : FFmpegCommandBuilder::stutterLoopCmd(ffmpegPath_, input, start, duration, repeats, hasAudio, output, profile);
+    // the -t of the loop form is only the fragment; the output holds every repeat
+    double looped = std::max(1, repeats) * duration;
+    double outputSeconds = inPlace ? (srcDuration > 0.0 ? srcDuration - duration + looped : 0.0) : looped;
+    return runCommand(cmd, dryRun, outputSeconds);
 }
 
-int RemixRuleEngine::processOverlay(const std::string &input, const std::string &overlay, double start, double end, double scale, const std::string &position, const std::string &output, bool dryRun) {
-    auto cmd = FFmpegCommandBuilder::overlayCmd(ffmpegPath_, input, overlay, start, end, scale, position, output);
+int RemixRuleEngine::processOverlay(const std::string &input, const std::string &overlay, double start, double end, double scale, const std::string &position, const std::string &output, const EncodingProfile &profile, bool dryRun) {
+    auto cmd = FFmpegCommandBuilder::overlayCmd(ffmpegPath_, input, overlay, start, end, scale, position, output, profile);
     return runCommand(cmd, dryRun);
 }
 
-int RemixRuleEngine::processPitch(const std::string &input, double semitones, const std::string &output, bool dryRun) {
-    auto cmd = FFmpegCommandBuilder::pitchShiftCmd(ffmpegPath_, input, semitones, output);
+int RemixRuleEngine::processPitch(const std::string &input, double semitones, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun) {
+    auto cmd = FFmpegCommandBuilder::pitchShiftCmd(ffmpegPath_, input, semitones, output, profile, !reencode);
     return runCommand(cmd, dryRun);
 }
 
-int RemixRuleEngine::processRandomChop(const std::string &input, int count, double min_len, double max_len, bool shuffle, const std::string &output, bool dryRun) {
-    double duration = 0.0;
-    {
-        fs::path probe = fs::path(ffmpegPath_).parent_path() / "ffprobe.exe";
-        if (fs::exists(probe)) {
-            std::ostringstream pcmd;
-            pcmd << '"' << probe.string() << "\" -v error -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 " << FFmpegCommandBuilder::quote(input);
-            FILE *pipe = _popen(pcmd.str().c_str(), "r");
-            if (pipe) {
-                char buf[128];
-                if (fgets(buf, sizeof(buf), pipe)) {
-                    try { duration = std::stod(buf); } catch (...) { duration = 0.0; }
-                }
-                _pclose(pipe);
-            }
-        }
+bool RemixRuleEngine::probeInput(const std::string &input, double &duration, bool &hasAudio) {
+    util::ProcessOptions opts;
+    opts.captureStdout = true;
+    std::vector<std::string> argv = { util::toolPath(ffmpegPath_, "ffprobe"), "-v", "error",
+                                      "-show_entries", "format=duration:stream=codec_type",
+                                      "-of", "default=noprint_wrappers=1:nokey=1", input };
+    auto pr = util::runProcess(argv, opts);
+    Trace::recordChild("ffprobe " + fs::path(input).filename().string(), argv, pr);
+    if (pr.exitCode != 0) return false;
+    // one line per stream codec_type, plus the format duration
+    double d = 0.0;
+    bool audio = false;
+    std::istringstream lines(pr.out);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.rfind("audio", 0) == 0) { audio = true; continue; }
+        try { d = std::stod(line); } catch (...) {}
     }
+    if (d <= 0.0) return false;
+    duration = d;
+    hasAudio = audio;
+    return true;
+}
 
-    if (duration <= 0.0) {
+int RemixRuleEngine::processRandomChop(size_t opIndex, const std::string &input, int count, double min_len, double max_len, bool shuffle, long long seed, std::vector<std::pair<double,double>> segs, int workers, const std::string &mode, int filtergraphThreshold, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun) {
+    double duration = 0.0;
+    bool hasAudio = true;
+    if (!probeInput(input, duration, hasAudio)) {
         duration = 60.0;
         std::cout << "Warning: unable to probe duration; assuming " << duration << "s\n";
     }
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> startDist(0.0, std::max(0.0, duration - min_len));
-    std::uniform_real_distribution<> lenDist(min_len, max_len);
+    // explicit segments (a draft's resolved timeline) are used as given, in order
+    if (segs.empty()) {
+        std::random_device rd;
+        std::mt19937 gen(seed >= 0 ? (std::mt19937::result_type)seed : rd());
+        std::uniform_real_distribution<> startDist(0.0, std::max(0.0, duration - min_len));
+        std::uniform_real_distribution<> lenDist(min_len, max_len);
+
+        for (int i = 0; i < count; ++i) {
+            double len = lenDist(gen);
+            double start = startDist(gen);
+            if (start + len > duration) start = std::max(0.0, duration - len);
+            segs.emplace_back(start, len);
+        }
 
-    std::vector<std::pair<double,double>> segs;
-    for (int i = 0; i < count; ++i) {
-        double len = lenDist(gen);
-        double start = startDist(gen);
-        if (start + len > duration) start = std::max(0.0, duration - len);
-        segs.emplace_back(start, len);
+        if (shuffle) std::shuffle(segs.begin(), segs.end(), gen);
+    }
+    double total = 0.0;
+    for (auto &sg : segs) {
+        max_len = std::max(max_len, sg.second);
+        total += sg.second;
+    }
+    {
+        std::lock_guard<std::mutex> lk(timelineMutex_);
+        chopSegments_[opIndex] = segs;
     }
 
-    if (shuffle) std::shuffle(segs.begin(), segs.end(), gen);
+    // Many tiny segments are dominated by process startup: decode and encode once instead
+    bool useFilterGraph = mode == "filtergraph" || (mode == "auto" && (int)segs.size() >= filtergraphThreshold);
+    if (useFilterGraph) {
+        fs::path script = tempPath(opIndex, "rand_graph.txt");
+        std::ofstream sfs(script);
+        sfs << FFmpegCommandBuilder::randomChopFilterScript(segs, hasAudio);
+        sfs.close();
+        auto cmd = FFmpegCommandBuilder::randomChopFilterGraphCmd(ffmpegPath_, input, script.string(), hasAudio, output, profile);
+        return runCommand(cmd, dryRun, total);
+    }
 
-    std::vector<std::string> fragFiles;
-    for (int i = 0; i < (int)segs.size(); ++i) {
-        fs::path frag = fs::path(workdir_) / ("rand_frag_" + std::to_string(i) + ".mp4");
-        auto cmd = FFmpegCommandBuilder::randomChopExtractCmd(ffmpegPath_, input, i, segs[i].first, segs[i].second, frag.string());
-        if (runCommand(cmd, dryRun) != 0) return 1;
-        fragFiles.push_back(fs::absolute(frag).string());
+    // Extract fragments on the operation scheduler, at most `workers` at a time; slots are
+    // pre-sized so the concat list keeps segment order. Fragments get the op's own profile:
+    // the concat only copies them, so that is still the output's single encode.
+    if (workers <= 0) workers = coordinator_ ? coordinator_->maxJobs() : defaultWorkerCount();
+    // Long fragments of an h264 source copy their whole GOPs and encode only the edges; not when
+    // the source is an intermediate a final output must not copy from
+    bool smart = smartCut_ && media_ && !reencode && profile.videoCodec == "libx264" && max_len >= smartCutMinSeconds_
+        && inputInfo(input).codec == "h264";
+    std::vector<double> keyframes;
+    FFmpegCommandBuilder::SourceVideo source;
+    if (smart) keyframes = media_->keyframeTimes(input, &source);
+    std::vector<std::string> fragFiles(segs.size());
+    std::vector<FFmpegCommandBuilder::SmartCutPlan> plans(segs.size());
+    for (size_t i = 0; i < segs.size(); ++i) {
+        fs::path frag = tempPath(opIndex, "rand_frag_" + std::to_string(i) + ".mp4");
+        fragFiles[i] = fs::absolute(frag).string();
+        std::string prefix = tempPath(opIndex, "rand_frag_" + std::to_string(i) + "_part");
+        smart = smart && FFmpegCommandBuilder::smartCutPlan(ffmpegPath_, input, segs[i].first, segs[i].second, keyframes, source, smartCutMinSeconds_,
+                                                           prefix, prefix + "s.txt", hasAudio, frag.string(), profile, plans[i]);
+    }
+    // The concat copies every fragment under the first one's codec parameters, so an op's
+    // fragments are either all smart-cut or all fully encoded, never a mix
+    std::vector<std::vector<std::string>> cmds(segs.size()); // per fragment, run in order
+    for (size_t i = 0; i < segs.size(); ++i) {
+        if (smart) {
+            std::ofstream pfs(tempPath(opIndex, "rand_frag_" + std::to_string(i) + "_parts.txt"));
+            for (auto &p : plans[i].parts) pfs << "file '" << fs::absolute(p).string() << "'\n";
+            cmds[i] = plans[i].partCmds;
+            cmds[i].push_back(plans[i].muxCmd);
+        } else {
+            cmds[i].push_back(FFmpegCommandBuilder::randomChopExtractCmd(ffmpegPath_, input, (int)i, segs[i].first, segs[i].second,
+                                                                            tempPath(opIndex, "rand_frag_" + std::to_string(i) + ".mp4"), profile));
+        }
+    }
+    if (smart && !tlPlan) {
+        std::lock_guard<std::mutex> lk(logMutex_);
+        std::cout << "random_chop: " << segs.size() << " fragments smart-cut at keyframes\n";
+    }
+    std::atomic<bool> failed{false};
+    {
+        util::TaskGroup group(*pool_);
+        std::atomic<size_t> next{0};
+        std::vector<std::string> *plan = tlPlan;
+        const util::CancellationToken *cancel = tlCancel;
+        size_t runners = std::min<size_t>((size_t)workers, std::max<size_t>(1, segs.size()));
+        for (size_t r = 0; r < runners; ++r) {
+            group.run([this, &cmds, &next, &failed, &group, dryRun, plan, cancel]() {
+                std::vector<std::string> *saved = tlPlan;
+                const util::CancellationToken *savedCancel = tlCancel;
+                tlPlan = plan;
+                tlCancel = cancel;
+                // once one extract fails the remaining ones are dropped instead of launched
+                for (size_t i; !group.cancelled() && (i = next++) < cmds.size();) {
+                    for (auto &cmd : cmds[i]) {
+                        if (runCommand(cmd, dryRun) == 0) continue;
+                        failed = true;
+                        group.cancel();
+                        break;
+                    }
+                }
+                tlPlan = saved;
+                tlCancel = savedCancel;
+            });
+        }
+        group.wait();
     }
+    if (failed.load()) return 1;
 
-    fs::path listFile = fs::path(workdir_) / "rand_list.txt";
+    fs::path listFile = tempPath(opIndex, "rand_list.txt");
     std::ofstream ofs(listFile);
     for (auto &f : fragFiles) {
         ofs << "file '" << f << "'\n";
@@ -110,54 +355,738 @@ int RemixRuleEngine::processRandomChop(const std::string &input, int count, doub
     ofs.close();
 
     auto concatCmd = FFmpegCommandBuilder::concatFromListCmd(ffmpegPath_, listFile.string(), output);
-    return runCommand(concatCmd, dryRun);
+    return runCommand(concatCmd, dryRun, total);
 }
 
-int RemixRuleEngine::processConcat(const std::vector<std::string> &inputs, const std::string &output, bool dryRun) {
-    fs::path listFile = fs::path(workdir_) / "concat_list.txt";
+int RemixRuleEngine::processConcat(size_t opIndex, const std::vector<std::string> &inputs, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun) {
+    fs::path listFile = tempPath(opIndex, "concat_list.txt");
     std::ofstream ofs(listFile);
     for (auto &p : inputs) {
         ofs << "file '" << fs::absolute(p).string() << "'\n";
     }
     ofs.close();
-    auto cmd = FFmpegCommandBuilder::concatFromListCmd(ffmpegPath_, listFile.string(), output);
+    auto cmd = FFmpegCommandBuilder::concatFromListCmd(ffmpegPath_, listFile.string(), output, reencode ? &profile : nullptr);
     return runCommand(cmd, dryRun);
 }
 
-int RemixRuleEngine::processBleep(const std::string &input, const std::vector<std::pair<double,double>> &ranges, const std::string &output, bool dryRun) {
+int RemixRuleEngine::processBleep(const std::string &input, const std::vector<std::pair<double,double>> &ranges, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun) {
     if (ranges.empty()) {
         std::cerr << "bleep: no timestamp ranges provided\n";
         return 1;
     }
-    auto cmd = FFmpegCommandBuilder::bleepCensorCmd(ffmpegPath_, input, ranges, output);
+    auto cmd = FFmpegCommandBuilder::bleepCensorCmd(ffmpegPath_, input, ranges, output, profile, !reencode);
     return runCommand(cmd, dryRun);
 }
 
-int RemixRuleEngine::processPreview(const std::string &file, bool loop, bool dryRun) {
-    // Locate ffplay next to ffmpeg
-    fs::path ffplay = fs::path(ffmpegPath_).parent_path() / "ffplay.exe";
-    if (!fs::exists(ffplay)) {
-        std::cerr << "ffplay not found next to ffmpeg: " << ffplay << "\n";
-        return 2;
+int RemixRuleEngine::processFused(const json &spec, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun) {
+    std::vector<FFmpegCommandBuilder::ChainStage> stages;
+    for (auto &stageSpec : spec["stages"]) {
+        FFmpegCommandBuilder::ChainStage st;
+        if (!chainStageFromSpec(stageSpec, st)) return 6;
+        stages.push_back(st);
     }
+    auto cmd = FFmpegCommandBuilder::fusedChainCmd(ffmpegPath_, spec["input"].get<std::string>(), stages, output, profile, !reencode);
+    return runCommand(cmd, dryRun);
+}
+
+int RemixRuleEngine::processPreview(const std::string &file, bool loop, bool dryRun) {
+    // Locate ffplay next to ffmpeg, falling back to PATH
+    std::string ffplay = util::toolPath(ffmpegPath_, "ffplay");
     if (dryRun) {
         std::cout << "[preview] would play: " << file << " (loop=" << loop << ")\n";
         return 0;
     }
 
     // Use PreviewPlayer to run/stop ffplay
-    PreviewPlayer player(ffplay.string());
+    PreviewPlayer player(ffplay);
     bool started = player.play(file, loop);
     if (!started) return 3;
 
     std::cout << "Preview started. Close the ffplay window to continue, or press Enter to stop early...\n";
+    // a preview following a playlist whose op failed closes the player; Enter still continues
+    std::atomic<bool> done{false};
+    std::thread watcher;
+    if (const util::CancellationToken *cancel = tlCancel) {
+        watcher = std::thread([&, cancel]() {
+            while (!done.load()) {
+                if (cancel->cancelled()) {
+                    if (player.stop()) std::cout << "Preview input failed; player closed. Press Enter to continue...\n";
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        });
+    }
     // Wait for user input to stop early
     std::string s;
     std::getline(std::cin, s);
+    done = true;
+    if (watcher.joinable()) watcher.join();
     player.stop();
+    return tlCancel && tlCancel->cancelled() ? 1 : 0;
+}
+
+// Comparable form of a path so "output/a.mp4" and "./output/a.mp4" match in the DAG
+static std::string pathKey(const std::string &p) {
+    try {
+        return fs::absolute(p).lexically_normal().string();
+    } catch (...) {
+        return p;
+    }
+}
+
+static std::string defaultOutputName(const std::string &type) {
+    if (type == "stutter") return "stutter_out.mp4";
+    if (type == "overlay") return "overlay_out.mp4";
+    if (type == "pitch") return "pitch_out.mp4";
+    if (type == "random_chop") return "rand_out.mp4";
+    if (type == "concat") return "concat_out.mp4";
+    if (type == "bleep") return "bleep_out.mp4";
+    return "";
+}
+
+json RemixRuleEngine::draftOperations(const json &ops, const std::string &workdir, size_t &proxied) const {
+    proxied = 0;
+    // an asset, or its normalized copy, -> the asset's proxy (when makeProxies produced one)
+    std::unordered_map<std::string, std::string> proxies;
+    if (media_) {
+        for (const MediaEntry &e : media_->entries()) {
+            if (e.type != MediaType::Video && e.type != MediaType::Gif) continue;
+            std::string proxy = media_->proxyPathFor(e.path);
+            if (!fs::exists(proxy)) continue;
+            proxies[pathKey(e.path)] = proxy;
+            proxies[pathKey(media_->normalizedPathFor(e.path))] = proxy;
+        }
+    }
+
+    // every written file (defaults made explicit) -> its draft name
+    json out = ops;
+    std::unordered_map<std::string, std::string> renamed;
+    for (auto &spec : out) {
+        if (!spec.is_object() || !spec.contains("type") || !spec["type"].is_string()) continue;
+        std::string type = spec["type"].get<std::string>();
+        if (type == "preview") continue;
+        fs::path output = spec.value("output", (fs::path(workdir) / defaultOutputName(type)).string());
+        std::string draft = (output.parent_path() / (output.stem().string() + "_draft" + output.extension().string())).string();
+        renamed[pathKey(output.string())] = draft;
+        spec["output"] = draft;
+    }
+    auto substitute = [&](json &value) {
+        if (!value.is_string()) return;
+        std::string key = pathKey(value.get<std::string>());
+        auto it = renamed.find(key);
+        if (it != renamed.end()) {
+            value = it->second;
+            return;
+        }
+        it = proxies.find(key);
+        if (it != proxies.end()) {
+            value = it->second;
+            ++proxied;
+        }
+    };
+    for (auto &spec : out) {
+        if (!spec.is_object()) continue;
+        for (const char *key : { "input", "overlay", "file" }) {
+            if (spec.contains(key)) substitute(spec[key]);
+        }
+        if (spec.contains("inputs") && spec["inputs"].is_array()) {
+            for (auto &it : spec["inputs"]) substitute(it);
+        }
+    }
+    return out;
+}
+
+bool RemixRuleEngine::writeTimeline(json rules, const std::string &jsonPath, const std::string &workdir, const std::string &draftProfile) {
+    {
+        std::lock_guard<std::mutex> lk(timelineMutex_);
+        for (auto &c : chopSegments_) {
+            if (c.first >= rules["operations"].size()) continue;
+            json segs = json::array();
+            for (auto &sg : c.second) segs.push_back({ {"start", sg.first}, {"duration", sg.second} });
+            rules["operations"][c.first]["segments"] = segs;
+        }
+    }
+    rules["timeline"] = { {"rules", jsonPath}, {"draft_profile", draftProfile} };
+    fs::path path = fs::path(workdir) / "timeline.json";
+    fs::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream ofs(tmp);
+        if (!ofs) return false;
+        ofs << rules.dump(2) << "\n";
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) return false;
+    std::cout << "Draft timeline written to " << path.string() << "; render it at full quality with --final\n";
+    return true;
+}
+
+std::vector<RemixRuleEngine::Operation> RemixRuleEngine::buildOperations(const json &ops, const std::string &workdir) {
+    std::vector<Operation> out;
+    for (auto &spec : ops) {
+        Operation op;
+        op.index = out.size();
+        op.spec = spec;
+        if (spec.is_object() && spec.contains("type") && spec["type"].is_string()) {
+            op.type = spec["type"].get<std::string>();
+        }
+        if (!op.type.empty() && op.type != "preview") {
+            op.output = spec.value("output", (fs::path(workdir) / defaultOutputName(op.type)).string());
+            op.segmented = spec.value("segmented", false);
+        }
+        if (spec.is_object()) {
+            for (const char *key : { "input", "overlay", "file" }) {
+                if (spec.contains(key) && spec[key].is_string()) op.inputs.push_back(spec[key].get<std::string>());
+            }
+            if (spec.contains("inputs") && spec["inputs"].is_array()) {
+                for (auto &it : spec["inputs"]) {
+                    if (it.is_string()) op.inputs.push_back(it.get<std::string>());
+                }
+            }
+        }
+
+        // An op waits for every earlier op that writes a file it reads (read-after-write),
+        // reads the file it writes (write-after-read) or writes the same file (write-after-write).
+        std::vector<std::string> inKeys;
+        for (auto &in : op.inputs) inKeys.push_back(pathKey(in));
+        std::string outKey = op.output.empty() ? "" : pathKey(op.output);
+        for (auto &prev : out) {
+            bool dep = false;
+            std::string prevOut = prev.output.empty() ? "" : pathKey(prev.output);
+            if (!prevOut.empty()) {
+                for (auto &k : inKeys) if (k == prevOut) dep = true;
+                if (!outKey.empty() && outKey == prevOut) dep = true;
+            }
+            if (!outKey.empty()) {
+                for (auto &in : prev.inputs) if (pathKey(in) == outKey) dep = true;
+            }
+            // previews wait for the console, keep them in rule order
+            if (op.type == "preview" && prev.type == "preview") dep = true;
+            if (dep) op.deps.push_back(prev.index);
+        }
+        out.push_back(op);
+    }
+    return out;
+}
+
+size_t RemixRuleEngine::fuseChains(std::vector<Operation> &ops) {
+    if (!fuseEnabled_) return 0;
+    std::vector<std::vector<size_t>> dependents(ops.size());
+    for (auto &op : ops) for (size_t d : op.deps) dependents[d].push_back(op.index);
+    std::vector<char> fusable(ops.size(), 0);
+    FFmpegCommandBuilder::ChainStage st;
+    for (auto &op : ops) fusable[op.index] = chainStageFromSpec(op.spec, st);
+
+    size_t absorbed = 0;
+    for (auto &op : ops) {
+        if (!fusable[op.index]) continue;
+        std::string in = pathKey(op.spec["input"].get<std::string>());
+        if (pathKey(op.output) == in) continue;
+        // the op writing this op's main input joins it when nothing else needs that file:
+        // no other reader, no other dependency of any kind, and no "keep", own "profile" or
+        // segmented output on it
+        for (size_t a : op.deps) {
+            Operation &prev = ops[a];
+            if (!fusable[a] || prev.spec.value("keep", false) || prev.spec.contains("profile") || prev.segmented || pathKey(prev.output) != in) continue;
+            if (dependents[a].size() != 1) continue;
+            if (std::count_if(op.inputs.begin(), op.inputs.end(), [&](const std::string &p) { return pathKey(p) == in; }) != 1) continue;
+
+            std::vector<size_t> stages = prev.stages.empty() ? std::vector<size_t>{ a } : prev.stages;
+            stages.push_back(op.index);
+            op.stages = stages;
+            prev.stages.clear();
+            prev.fusedInto = op.index;
+
+            std::vector<size_t> deps = prev.deps;
+            for (size_t d : op.deps) if (d != a && std::find(deps.begin(), deps.end(), d) == deps.end()) deps.push_back(d);
+            op.deps = deps;
+            std::vector<std::string> inputs = prev.inputs;
+            for (auto &p : op.inputs) if (pathKey(p) != in) inputs.push_back(p);
+            op.inputs = inputs;
+            prev.deps.clear();
+            prev.inputs.clear();
+            ++absorbed;
+            break;
+        }
+    }
+
+    // a chain runs as its last op, with every stage's parameters in its spec
+    for (auto &op : ops) {
+        if (op.stages.empty()) continue;
+        json stageSpecs = json::array();
+        for (size_t k : op.stages) {
+            stageSpecs.push_back(ops[k].spec);
+            if (k != op.index) ops[k].fusedInto = op.index;
+        }
+        std::string input = ops[op.stages.front()].spec["input"].get<std::string>();
+        op.spec = { {"type", "fused"}, {"input", input}, {"stages", stageSpecs}, {"output", op.output} };
+        op.type = "fused";
+    }
+    return absorbed;
+}
+
+std::unordered_map<std::string, std::string> RemixRuleEngine::normalizedCopies() const {
+    std::unordered_map<std::string, std::string> copies;
+    if (!media_) return copies;
+    for (const MediaEntry &e : media_->entries()) {
+        if (e.type == MediaType::Video || e.type == MediaType::Gif) copies.emplace(pathKey(media_->normalizedPathFor(e.path)), e.path);
+    }
+    return copies;
+}
+
+size_t RemixRuleEngine::addNormalizeSteps(std::vector<Operation> &ops) {
+    if (!media_ || !lazyNormalize_) return 0;
+    std::unordered_map<std::string, std::string> sources = normalizedCopies();
+    // a path some rule writes itself is that rule's output, not a normalized asset
+    for (auto &op : ops) if (!op.output.empty()) sources.erase(pathKey(op.output));
+
+    std::unordered_map<std::string, size_t> steps; // normalized path -> its normalize op
+    size_t userOps = ops.size();
+    for (size_t i = 0; i < userOps; ++i) {
+        std::vector<size_t> needs;
+        for (auto &in : ops[i].inputs) {
+            std::string key = pathKey(in);
+            auto src = sources.find(key);
+            if (src == sources.end()) continue;
+            auto it = steps.find(key);
+            if (it == steps.end()) {
+                Operation step;
+                step.index = ops.size();
+                step.type = "normalize";
+                step.output = media_->normalizedPathFor(src->second);
+                step.inputs.push_back(src->second);
+                step.spec = { {"type", "normalize"}, {"input", src->second}, {"output", step.output} };
+                it = steps.emplace(key, step.index).first;
+                ops.push_back(step);
+            }
+            needs.push_back(it->second);
+        }
+        for (size_t d : needs) {
+            if (std::find(ops[i].deps.begin(), ops[i].deps.end(), d) == ops[i].deps.end()) ops[i].deps.push_back(d);
+        }
+    }
+    return ops.size() - userOps;
+}
+
+std::string RemixRuleEngine::playlistFor(const std::string &output) {
+    fs::path out(output);
+    return (out.parent_path() / (out.stem().string() + "_hls") / "index.m3u8").string();
+}
+
+size_t RemixRuleEngine::linkStreams(std::vector<Operation> &ops) {
+    size_t edges = 0;
+    for (auto &op : ops) {
+        // ops that read their main input once, front to back, without probing it first
+        const char *key = op.type == "preview" ? "file" : "input";
+        if (op.type != "pitch" && op.type != "bleep" && op.type != "overlay" && op.type != "fused" && op.type != "preview") continue;
+        if (!op.spec.contains(key) || !op.spec[key].is_string()) continue;
+        std::string in = pathKey(op.spec[key].get<std::string>());
+        for (size_t d : op.deps) {
+            const Operation &prev = ops[d];
+            if (!prev.segmented || pathKey(prev.output) != in) continue;
+            // only when that input is all that ties the two ops together
+            if (!op.output.empty() && pathKey(op.output) == in) continue;
+            if (std::count_if(op.inputs.begin(), op.inputs.end(), [&](const std::string &p) { return pathKey(p) == in; }) != 1) continue;
+            op.streamDeps.push_back(d);
+            ++edges;
+        }
+    }
+    return edges;
+}
+
+// A playlist with at least one finished segment
+static bool playlistHasSegment(const std::string &playlist) {
+    std::ifstream ifs(playlist);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.rfind("#EXTINF", 0) == 0) return true;
+    }
+    return false;
+}
+
+size_t RemixRuleEngine::assignProfiles(std::vector<Operation> &ops, const std::string &deliveryName, const std::string &intermediateName) {
+    const EncodingProfile &delivery = profiles_.get(deliveryName, "delivery");
+    const EncodingProfile &intermediate = profiles_.get(intermediateName, "intermediate");
+    // outputs some later op reads (fused-away ops have no readers left but their chain)
+    std::vector<char> read(ops.size(), 0);
+    for (auto &op : ops) {
+        for (size_t d : op.deps) {
+            if (ops[d].output.empty()) continue;
+            std::string out = pathKey(ops[d].output);
+            for (auto &in : op.inputs) if (pathKey(in) == out) read[d] = 1;
+        }
+    }
+
+    // files written with an intermediate profile, by this run or by up-front normalization
+    std::unordered_set<std::string> intermediates;
+    if (media_ && media_->encodingProfile().intermediate) {
+        for (auto &c : normalizedCopies()) intermediates.insert(c.first);
+    }
+    size_t count = 0;
+    for (auto &op : ops) {
+        if (op.output.empty() || op.fusedInto != (size_t)-1) continue;
+        if (op.type == "normalize") {
+            op.profile = media_->encodingProfile();
+        } else {
+            // a fused chain writes its last stage's output
+            const json &own = op.stages.empty() ? op.spec : op.spec["stages"].back();
+            op.profile = read[op.index] && !own.value("keep", false) ? intermediate : delivery;
+            std::string name = own.value("profile", "");
+            // drafts encode everything with the draft profile
+            if (!name.empty() && !draft_) op.profile = profiles_.get(name, op.profile.name);
+        }
+        if (op.profile.intermediate) {
+            intermediates.insert(pathKey(op.output));
+            ++count;
+        }
+    }
+    for (auto &op : ops) {
+        if (op.output.empty() || op.profile.intermediate) continue;
+        for (auto &in : op.inputs) if (intermediates.count(pathKey(in))) op.reencode = true;
+    }
+    return count;
+}
+
+int RemixRuleEngine::executeOperation(const Operation &op, bool dryRun) {
+    const json &spec = op.spec;
+    if (op.type.empty()) {
+        std::cerr << "Operation missing type; skipping.\n";
+        return 0;
+    }
+    if (op.segmented) {
+        // the op writes the playlist; the mp4 is what later ops and the cache see
+        Operation run = op;
+        run.segmented = false;
+        run.output = playlistFor(op.output);
+        if (!dryRun) {
+            std::error_code ec;
+            fs::remove_all(fs::path(run.output).parent_path(), ec);
+            fs::create_directories(fs::path(run.output).parent_path(), ec);
+        }
+        int rc = executeOperation(run, dryRun);
+        if (rc != 0) return rc;
+        return runCommand(FFmpegCommandBuilder::remuxCmd(ffmpegPath_, run.output, op.output), dryRun);
+    }
+    const std::string &type = op.type;
+
+    if (type == "stutter") {
+        std::string input = spec["input"].get<std::string>();
+        double start = spec.value("start", 0.0);
+        double duration = spec.value("duration", 0.25);
+        int repeats = spec.value("repeats", 8);
+        bool inPlace = spec.value("in_place", false);
+        return processStutter(input, start, duration, repeats, inPlace, op.output, op.profile, dryRun);
+    } else if (type == "overlay") {
+        std::string input = spec["input"].get<std::string>();
+        std::string overlay = spec["overlay"].get<std::string>();
+        double start = spec.value("start", 0.0);
+        double end = spec.value("end", 9999.0);
+        double scale = spec.value("overlay_scale", 0.2);
+        std::string pos = spec.value("position", "topright");
+        return processOverlay(input, overlay, start, end, scale, pos, op.output, op.profile, dryRun);
+    } else if (type == "pitch") {
+        std::string input = spec["input"].get<std::string>();
+        double semi = spec.value("semitones", 0.0);
+        return processPitch(input, semi, op.output, op.profile, op.reencode, dryRun);
+    } else if (type == "random_chop") {
+        std::string input = spec["input"].get<std::string>();
+        int count = spec.value("count", 8);
+        double min_len = spec.value("min_len", 0.05);
+        double max_len = spec.value("max_len", 0.5);
+        bool shuffle = spec.value("shuffle", true);
+        long long seed = spec.value("seed", -1LL);
+        std::vector<std::pair<double,double>> segs;
+        if (spec.contains("segments") && spec["segments"].is_array()) {
+            for (auto &sg : spec["segments"]) segs.emplace_back(sg.value("start", 0.0), sg.value("duration", 0.0));
+        }
+        int workers = spec.value("workers", 0);
+        std::string mode = spec.value("mode", "auto");
+        int threshold = spec.value("filtergraph_threshold", 32);
+        return processRandomChop(op.index, input, count, min_len, max_len, shuffle, seed, segs, workers, mode, threshold, op.output, op.profile, op.reencode, dryRun);
+    } else if (type == "concat") {
+        if (!spec.contains("inputs") || !spec["inputs"].is_array()) {
+            std::cerr << "concat requires inputs array\n";
+            return 0;
+        }
+        std::vector<std::string> inputs;
+        for (auto &it : spec["inputs"]) inputs.push_back(it.get<std::string>());
+        return processConcat(op.index, inputs, op.output, op.profile, op.reencode, dryRun);
+    } else if (type == "bleep") {
+        std::string input = spec["input"].get<std::string>();
+        std::vector<std::pair<double,double>> ranges;
+        if (!bleepRanges(spec, ranges)) {
+            std::cerr << "bleep operation missing ranges array\n";
+            return 6;
+        }
+        return processBleep(input, ranges, op.output, op.profile, op.reencode, dryRun);
+    } else if (type == "fused") {
+        return processFused(spec, op.output, op.profile, op.reencode, dryRun);
+    } else if (type == "normalize") {
+        std::string input = spec["input"].get<std::string>();
+        if (dryRun || !media_) {
+            std::lock_guard<std::mutex> lk(logMutex_);
+            std::cout << "[exec] normalize " << input << " -> " << op.output << std::endl;
+            return 0;
+        }
+        // already-normalized unchanged assets return at once
+        if (media_->normalizeMedia(input, normalizeWidth_, normalizeHeight_, normalizeFps_, pool_).empty()) {
+            std::lock_guard<std::mutex> lk(logMutex_);
+            std::cerr << "Normalization failed for: " << input << std::endl;
+            return 7;
+        }
+        return 0;
+    } else if (type == "preview") {
+        std::string file = spec["file"].get<std::string>();
+        bool loop = spec.value("loop", false);
+        return processPreview(file, loop, dryRun);
+    }
+    std::cerr << "Unknown operation type: " << type << " (skipping)\n";
     return 0;
 }
 
+int RemixRuleEngine::runCachedOperation(const Operation &op, bool dryRun, bool &fromCache) {
+    fromCache = false;
+    if (!op.type.empty()) {
+        std::lock_guard<std::mutex> lk(logMutex_);
+        std::cout << "Processing operation " << op.index << " type: " << op.type << std::endl;
+    }
+    // random_chop without a seed or explicit segments draws new ones every run, so it is never
+    // reusable; normalize steps are already skipped by MediaManager for unchanged assets;
+    // nor is an op following a playlist that is still growing
+    bool cacheable = cache_ && !dryRun && !op.output.empty() && op.type != "normalize" && !op.liveInput
+        && !(op.type == "random_chop" && !op.spec.contains("seed") && !op.spec.contains("segments"));
+    if (!cacheable) return executeOperation(op, dryRun);
+
+    // Plan the op's fully resolved ffmpeg commands without running them
+    std::vector<std::string> cmds;
+    tlPlan = &cmds;
+    int planned = 0;
+    try {
+        planned = executeOperation(op, true);
+    } catch (...) {
+        planned = -1;
+    }
+    tlPlan = nullptr;
+    if (planned != 0 || cmds.empty()) return executeOperation(op, dryRun);
+
+    // fragments are planned from several threads; order them so the key is stable
+    std::sort(cmds.begin(), cmds.end());
+    std::ostringstream k;
+    k << op.spec.dump() << "\n" << util::fileFingerprint(ffmpegPath_) << "\n";
+    for (auto &c : cmds) k << c << "\n";
+    for (auto &in : op.inputs) {
+        std::string fp = util::fileFingerprint(in);
+        if (fp.empty()) return executeOperation(op, dryRun); // missing input: let the op report it
+        k << pathKey(in) << "=" << fp << "\n";
+    }
+    std::string key = util::hashString(k.str());
+
+    if (cache_->restore(key, op.output)) {
+        fromCache = true;
+        std::lock_guard<std::mutex> lk(logMutex_);
+        std::cout << "[cache] hit op " << op.index << " -> " << op.output << std::endl;
+        return 0;
+    }
+
+    // ffmpeg -y truncates in place; unlink first so a hardlinked cache entry is never rewritten
+    std::error_code ec;
+    fs::remove(op.output, ec);
+    int rc = executeOperation(op, dryRun);
+    if (rc == 0) cache_->store(key, op.output);
+    return rc;
+}
+
+int RemixRuleEngine::runOperations(std::vector<Operation> &ops, int workers, bool dryRun) {
+    enum class State { Pending, Done, Failed, Skipped, Cancelled };
+    std::vector<State> state(ops.size(), State::Pending);
+    std::vector<int> rcs(ops.size(), 0);
+    std::vector<bool> cached(ops.size(), false);
+    std::vector<size_t> blockedBy(ops.size(), 0);
+    std::vector<size_t> remaining(ops.size(), 0);
+    std::vector<std::vector<size_t>> dependents(ops.size());
+    for (auto &op : ops) {
+        remaining[op.index] = op.deps.size();
+        for (size_t d : op.deps) dependents[d].push_back(op.index);
+    }
+
+    // Critical-path priority: an op heads the queue when a long chain of ops waits behind it.
+    // Computed in reverse topological order; normalize steps sit after the ops waiting for them.
+    std::vector<size_t> order;
+    order.reserve(ops.size());
+    std::vector<size_t> indegree(remaining);
+    for (size_t i = 0; i < ops.size(); ++i) if (indegree[i] == 0) order.push_back(i);
+    for (size_t h = 0; h < order.size(); ++h) {
+        for (size_t d : dependents[order[h]]) if (--indegree[d] == 0) order.push_back(d);
+    }
+    std::vector<int> chain(ops.size(), 0);
+    for (size_t k = order.size(); k-- > 0;) {
+        size_t i = order[k];
+        for (size_t d : dependents[i]) chain[i] = std::max(chain[i], chain[d] + 1);
+    }
+
+    // Stream edges: these dependents are counted down once, on the op's first finished segment
+    // or when it finishes, whichever comes first
+    std::vector<std::vector<size_t>> streamDependents(ops.size());
+    for (auto &op : ops) for (size_t d : op.streamDeps) streamDependents[d].push_back(op.index);
+    std::vector<char> released(ops.size(), 0);
+    std::vector<char> early(ops.size(), 0); // started on a playlist that was still growing
+    // Running ops can be stopped: a stream reader whose producer fails is cancelled, which
+    // kills its ffmpeg; it counts as cancelled once it has exited
+    std::vector<util::CancellationToken> cancels(ops.size());
+    std::vector<char> running(ops.size(), 0);
+    std::vector<char> cancelRequested(ops.size(), 0);
+
+    std::mutex mtx;
+    auto releaseStreams = [&](size_t i, std::vector<size_t> &ready) { // mtx held
+        if (released[i]) return;
+        released[i] = 1;
+        for (size_t d : streamDependents[i]) {
+            if (--remaining[d] == 0 && state[d] == State::Pending) ready.push_back(d);
+        }
+    };
+    util::ThreadPool pool((size_t)std::max(1, workers));
+    pool_ = &pool;
+    util::TaskGroup group(pool);
+    std::function<void(size_t)> launch = [&](size_t i) {
+        group.run([&, i]() {
+            // follow the playlist of every stream dep that has not finished yet
+            const Operation *op = &ops[i];
+            Operation live;
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                // skipped between launch and start: a stream dep failed meanwhile
+                if (state[i] != State::Pending) return;
+                running[i] = 1;
+            }
+            if (!ops[i].streamDeps.empty()) {
+                live = ops[i];
+                std::lock_guard<std::mutex> lk(mtx);
+                for (size_t p : live.streamDeps) {
+                    if (state[p] == State::Done) continue;
+                    live.spec[live.type == "preview" ? "file" : "input"] = playlistFor(ops[p].output);
+                    live.liveInput = true;
+                    early[i] = 1;
+                }
+                op = &live;
+            }
+
+            // watch a segmented op's playlist for its first segment; a previous run's is removed first
+            std::atomic<bool> finished{false};
+            std::thread watcher;
+            if (!streamDependents[i].empty() && !dryRun) {
+                std::string playlist = playlistFor(ops[i].output);
+                std::error_code ec;
+                fs::remove_all(fs::path(playlist).parent_path(), ec);
+                watcher = std::thread([&, i, playlist]() {
+                    while (!finished.load()) {
+                        if (playlistHasSegment(playlist)) {
+                            std::vector<size_t> ready;
+                            {
+                                std::lock_guard<std::mutex> lk(mtx);
+                                releaseStreams(i, ready);
+                            }
+                            for (size_t r : ready) launch(r);
+                            return;
+                        }
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                });
+            }
+
+            int rc = 0;
+            bool fromCache = false;
+            {
+                Trace::Span span("op", "#" + std::to_string(i) + " " + ops[i].type);
+                tlCancel = &cancels[i];
+                try {
+                    rc = runCachedOperation(*op, dryRun, fromCache);
+                } catch (const std::exception &ex) {
+                    std::cerr << "Operation " << i << " (" << ops[i].type << ") error: " << ex.what() << std::endl;
+                    rc = 5;
+                }
+                tlCancel = nullptr;
+                span.arg("rc", rc);
+                span.arg("cached", fromCache);
+                if (!ops[i].output.empty()) span.arg("output", ops[i].output);
+            }
+            finished = true;
+            if (watcher.joinable()) watcher.join();
+
+            std::vector<size_t> ready;
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                rcs[i] = rc;
+                cached[i] = fromCache;
+                running[i] = 0;
+                if (cancelRequested[i]) {
+                    // started early on a playlist whose op then failed; its dependents were skipped then
+                    state[i] = State::Cancelled;
+                } else if (rc == 0) {
+                    state[i] = State::Done;
+                    releaseStreams(i, ready);
+                    for (size_t d : dependents[i]) {
+                        if (std::find(streamDependents[i].begin(), streamDependents[i].end(), d) != streamDependents[i].end()) continue;
+                        if (--remaining[d] == 0 && state[d] == State::Pending) ready.push_back(d);
+                    }
+                } else {
+                    // Cancel everything downstream of the failed op, leave other branches running;
+                    // stream readers already running on its playlist are stopped
+                    state[i] = State::Failed;
+                    std::vector<size_t> stack(dependents[i]);
+                    while (!stack.empty()) {
+                        size_t d = stack.back();
+                        stack.pop_back();
+                        if (state[d] != State::Pending || cancelRequested[d]) continue;
+                        if (running[d]) {
+                            cancelRequested[d] = 1;
+                            cancels[d].cancel();
+                        } else {
+                            state[d] = State::Skipped;
+                        }
+                        blockedBy[d] = i;
+                        stack.insert(stack.end(), dependents[d].begin(), dependents[d].end());
+                    }
+                }
+            }
+            for (size_t r : ready) launch(r);
+        }, chain[i] + 1);
+    };
+
+    for (auto &op : ops) {
+        if (op.deps.empty() && op.fusedInto == (size_t)-1) launch(op.index);
+    }
+    group.wait();
+    pool_ = nullptr;
+
+    int result = 0;
+    std::cout << "Operation summary:\n";
+    for (auto &op : ops) {
+        size_t i = op.index;
+        if (op.fusedInto != (size_t)-1) {
+            std::cout << "  [" << i << "] " << op.spec.value("type", "?") << " -> " << op.output << ": fused into [" << op.fusedInto << "]\n";
+            continue;
+        }
+        std::cout << "  [" << i << "] " << (op.type.empty() ? "?" : op.type);
+        if (!op.stages.empty()) {
+            std::cout << " (";
+            for (size_t k = 0; k < op.stages.size(); ++k) std::cout << (k ? "+" : "") << op.spec["stages"][k].value("type", "?");
+            std::cout << ")";
+        }
+        if (!op.output.empty()) std::cout << " -> " << op.output << " (" << op.profile.name << (op.reencode ? ", re-encoded" : "") << ")";
+        if (early[i]) std::cout << " [started on segments]";
+        switch (state[i]) {
+            case State::Done: std::cout << (cached[i] ? ": ok (cached)\n" : ": ok\n"); break;
+            case State::Failed: std::cout << ": failed (rc=" << rcs[i] << ")\n"; break;
+            case State::Skipped: std::cout << ": skipped (depends on failed op " << blockedBy[i] << ")\n"; break;
+            case State::Cancelled: std::cout << ": cancelled (depends on failed op " << blockedBy[i] << ")\n"; break;
+            case State::Pending: std::cout << ": not run\n"; break;
+        }
+        if (result == 0 && state[i] == State::Failed) result = rcs[i];
+    }
+    return result;
+}
+
 int RemixRuleEngine::runFromJson(const std::string &jsonPath, bool dryRun) {
     std::ifstream ifs(jsonPath);
     if (!ifs) {
@@ -168,9 +1097,32 @@ int RemixRuleEngine::runFromJson(const std::string &jsonPath, bool dryRun) {
     try { ifs >> j; } catch (const std::exception &ex) { std::cerr << "JSON parse error: " << ex.what() << std::endl; return 3; }
 
     std::string workdir = workdir_;
-    if (j.contains("global") && j["global"].contains("workdir")) {
-        workdir = j["global"]["workdir"].get<std::string>();
-        if (!fs::exists(workdir)) fs::create_directories(workdir);
+    int workers = 0; // 0 -> auto
+    double cacheMaxMb = 4096.0;
+    std::string cacheDir;
+    // this run's profile names; the engine's defaults stay as configured
+    std::string deliveryName = deliveryProfile_;
+    std::string intermediateName = intermediateProfile_;
+    std::string draftName = draftProfile_;
+    if (j.contains("global") && j["global"].is_object()) {
+        auto &g = j["global"];
+        if (g.contains("workdir")) {
+            workdir = g["workdir"].get<std::string>();
+            if (!fs::exists(workdir)) fs::create_directories(workdir);
+        }
+        tempPrefix_ = g.value("temp_prefix", tempPrefix_);
+        smartCut_ = g.value("smart_cut", true);
+        smartCutMinSeconds_ = g.value("smart_cut_min_seconds", 3.0);
+        segmentSeconds_ = g.value("segment_seconds", 2.0);
+        draftName = g.value("draft_profile", draftName);
+        workers = g.value("operation_workers", 0);
+        fuseEnabled_ = g.value("fuse_operations", true);
+        if (g.contains("profiles")) profiles_.load(g["profiles"]);
+        deliveryName = g.value("delivery_profile", deliveryName);
+        intermediateName = g.value("intermediate_profile", intermediateName);
+        commandTimeout_ = g.value("command_timeout", 0.0);
+        cacheMaxMb = g.value("cache_max_mb", cacheMaxMb);
+        cacheDir = g.value("cache_dir", "");
     }
 
     if (!j.contains("operations") || !j["operations"].is_array()) {
@@ -178,82 +1130,54 @@ int RemixRuleEngine::runFromJson(const std::string &jsonPath, bool dryRun) {
         return 4;
     }
 
-    for (auto &op : j["operations"]) {
-        if (!op.contains("type")) {
-            std::cerr << "Operation missing type; skipping.\n";
-            continue;
-        }
-        std::string type = op["type"].get<std::string>();
-        std::cout << "Processing operation type: " << type << std::endl;
-
-        if (type == "stutter") {
-            std::string input = op["input"].get<std::string>();
-            double start = op.value("start", 0.0);
-            double duration = op.value("duration", 0.25);
-            int repeats = op.value("repeats", 8);
-            std::string output = op.value("output", (fs::path(workdir) / "stutter_out.mp4").string());
-            int r = processStutter(input, start, duration, repeats, output, dryRun);
-            if (r != 0) return r;
-        } else if (type == "overlay") {
-            std::string input = op["input"].get<std::string>();
-            std::string overlay = op["overlay"].get<std::string>();
-            double start = op.value("start", 0.0);
-            double end = op.value("end", 9999.0);
-            double scale = op.value("overlay_scale", 0.2);
-            std::string pos = op.value("position", "topright");
-            std::string output = op.value("output", (fs::path(workdir) / "overlay_out.mp4").string());
-            int r = processOverlay(input, overlay, start, end, scale, pos, output, dryRun);
-            if (r != 0) return r;
-        } else if (type == "pitch") {
-            std::string input = op["input"].get<std::string>();
-            double semi = op.value("semitones", 0.0);
-            std::string output = op.value("output", (fs::path(workdir) / "pitch_out.mp4").string());
-            int r = processPitch(input, semi, output, dryRun);
-            if (r != 0) return r;
-        } else if (type == "random_chop") {
-            std::string input = op["input"].get<std::string>();
-            int count = op.value("count", 8);
-            double min_len = op.value("min_len", 0.05);
-            double max_len = op.value("max_len", 0.5);
-            bool shuffle = op.value("shuffle", true);
-            std::string output = op.value("output", (fs::path(workdir) / "rand_out.mp4").string());
-            int r = processRandomChop(input, count, min_len, max_len, shuffle, output, dryRun);
-            if (r != 0) return r;
-        } else if (type == "concat") {
-            if (!op.contains("inputs") || !op["inputs"].is_array()) {
-                std::cerr << "concat requires inputs array\n";
-                continue;
-            }
-            std::vector<std::string> inputs;
-            for (auto &it : op["inputs"]) inputs.push_back(it.get<std::string>());
-            std::string output = op.value("output", (fs::path(workdir) / "concat_out.mp4").string());
-            int r = processConcat(inputs, output, dryRun);
-            if (r != 0) return r;
-        } else if (type == "bleep") {
-            std::string input = op["input"].get<std::string>();
-            std::string output = op.value("output", (fs::path(workdir) / "bleep_out.mp4").string());
-            std::vector<std::pair<double,double>> ranges;
-            if (op.contains("ranges") && op["ranges"].is_array()) {
-                for (auto &r : op["ranges"]) {
-                    double s = r.value("start", 0.0);
-                    double e = r.value("end", s + 0.5);
-                    ranges.emplace_back(s, e);
-                }
-            } else {
-                std::cerr << "bleep operation missing ranges array\n";
-                return 6;
-            }
-            int rc = processBleep(input, ranges, output, dryRun);
-            if (rc != 0) return rc;
-        } else if (type == "preview") {
-            std::string file = op["file"].get<std::string>();
-            bool loop = op.value("loop", false);
-            int rc = processPreview(file, loop, dryRun);
-            if (rc != 0) return rc;
-        } else {
-            std::cerr << "Unknown operation type: " << type << " (skipping)\n";
+    // a final render runs the timeline the last draft resolved, under these rules' globals
+    if (final_) {
+        fs::path timelinePath = fs::path(workdir) / "timeline.json";
+        std::ifstream tfs(timelinePath);
+        json timeline = tfs ? json::parse(tfs, nullptr, false) : json();
+        if (!timeline.is_object() || !timeline.contains("operations") || !timeline["operations"].is_array()) {
+            std::cerr << "No draft timeline at " << timelinePath.string() << "; run with --draft first\n";
+            return 4;
         }
+        j["operations"] = timeline["operations"];
+        std::cout << "Rendering the draft timeline " << timelinePath.string() << " at full quality\n";
+    }
+    json rules = j;
+    size_t proxied = 0;
+    if (draft_) {
+        j["operations"] = draftOperations(j["operations"], workdir, proxied);
+        deliveryName = draftName;
+        intermediateName = draftName;
+        std::lock_guard<std::mutex> lk(timelineMutex_);
+        chopSegments_.clear();
     }
 
-    return 0;
-}
\ No newline at end of file
+    // with a coordinator the job limit, not the op count, bounds concurrent ffmpeg children
+    if (workers <= 0) workers = coordinator_ ? coordinator_->maxJobs() : defaultWorkerCount();
+
+    cache_.reset();
+    if (cacheEnabled_ && !dryRun) {
+        if (cacheDir.empty()) cacheDir = (fs::path(workdir) / "cache").string();
+        cache_.reset(new OperationCache(cacheDir, (uint64_t)(std::max(0.0, cacheMaxMb) * 1024.0 * 1024.0)));
+    }
+
+    std::vector<Operation> ops = buildOperations(j["operations"], workdir);
+    size_t userOps = ops.size();
+    size_t fused = fuseChains(ops);
+    size_t normalizeSteps = addNormalizeSteps(ops);
+    size_t intermediates = assignProfiles(ops, deliveryName, intermediateName);
+    size_t streams = linkStreams(ops);
+    std::cout << "Running " << userOps << " operations using " << workers << " workers\n";
+    std::cout << "Encoding final outputs with profile '" << deliveryName << "', " << intermediates
+              << " intermediate outputs with '" << intermediateName << "'\n";
+    if (fused > 0) std::cout << "Fused " << fused << " operations into the ffmpeg pass of the next op in their chain\n";
+    if (normalizeSteps > 0) std::cout << "Normalizing " << normalizeSteps << " referenced assets on demand\n";
+    if (streams > 0) std::cout << streams << " operations can start on the first segments of their input\n";
+    if (draft_) std::cout << "Draft render: " << proxied << " inputs read proxies, outputs written as *_draft\n";
+    int rc = runOperations(ops, workers, dryRun);
+    if (cache_ && !cache_->saveIndex()) std::cerr << "Failed to write the operation cache index\n";
+    if (rc == 0 && draft_ && !dryRun && !writeTimeline(rules, jsonPath, workdir, draftName)) {
+        std::cerr << "Failed to write the draft timeline\n";
+    }
+    return rc;
+}
@@ -1,6 +1,17 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "ThreadPool.h"
+#include "EncodingProfile.h"
+
+class OperationCache;
+class ResourceCoordinator;
+class MediaManager;
+struct JobShape;
 
 class RemixRuleEngine {
 public:
@@ -9,21 +20,160 @@ public:
 
     int runFromJson(const std::string &jsonPath, bool dryRun = false);
 
+    // Reuse cached results of unchanged operations (on by default, --no-cache disables)
+    void setCacheEnabled(bool enabled) { cacheEnabled_ = enabled; }
+
+    // Admit every ffmpeg child through the shared CPU budget (null -> unmanaged)
+    void setCoordinator(ResourceCoordinator *coordinator) { coordinator_ = coordinator; }
+
+    // Scanned assets; inputs naming their normalized copies are treated as intermediates when
+    // the media manager's encoding profile is one
+    void setMediaManager(MediaManager *media) { media_ = media; }
+
+    // Lazy normalization (needs the media manager): an op input that names a scanned asset's
+    // normalized copy (the path normalizeAll would write) gets a normalize step in the operation
+    // graph, so only referenced assets are normalized, all of them in parallel, and each op
+    // starts once its own inputs are ready.
+    void setLazyNormalization(int width, int height, double fps) {
+        lazyNormalize_ = true;
+        normalizeWidth_ = width;
+        normalizeHeight_ = height;
+        normalizeFps_ = fps;
+    }
+
+    // Draft renders: inputs naming a scanned asset or its normalized copy read the asset's proxy
+    // (MediaManager::makeProxies) instead, every op encodes with global.draft_profile, outputs
+    // get a "_draft" suffix, and a successful run records the resolved timeline (the rules with
+    // each random_chop's drawn segments) in <workdir>/timeline.json
+    void setDraft(bool draft) { draft_ = draft; }
+
+    // Final renders: the operations of <workdir>/timeline.json, with this rules file's globals
+    void setFinal(bool final) { final_ = final; }
+
 private:
+    // One entry of the JSON `operations` array with its resolved file dependencies.
+    struct Operation {
+        size_t index = 0;
+        std::string type;
+        nlohmann::json spec;
+        std::vector<std::string> inputs; // files read by the op
+        std::string output;              // file written by the op (empty for preview)
+        std::vector<size_t> deps;        // ops that must finish first (earlier rules, or normalize steps)
+        size_t fusedInto = (size_t)-1;   // set when this op runs as a stage of that fused op
+        std::vector<size_t> stages;      // fused op: the rule ops it runs, in order
+        EncodingProfile profile;         // how the output is encoded
+        bool reencode = false;           // final output reading an intermediate: no stream copy
+        bool segmented = false;          // written as a growing HLS playlist first, then remuxed to output
+        std::vector<size_t> streamDeps;  // segmented deps whose playlist this op may follow while it grows
+        bool liveInput = false;          // this run reads a playlist that is still being written
+    };
+
     std::string ffmpegPath_;
     std::string workdir_;
+    std::string tempPrefix_ = "tmp_";
+    std::mutex logMutex_;
+    double commandTimeout_ = 0.0; // seconds per ffmpeg child, 0 -> none
+    bool cacheEnabled_ = true;
+    bool fuseEnabled_ = true;
+    EncodingProfiles profiles_;
+    // profile names used unless the rules' globals (or draft mode) pick others for a run
+    std::string deliveryProfile_ = "delivery";         // outputs nothing else reads
+    std::string intermediateProfile_ = "intermediate"; // outputs later ops read
+    bool smartCut_ = true;            // stream-copy whole GOPs of long extracts (needs media_)
+    double smartCutMinSeconds_ = 3.0; // shortest copied span worth the extra processes
+    double segmentSeconds_ = 2.0;     // HLS segment length of segmented outputs
+    bool draft_ = false;
+    bool final_ = false;
+    std::string draftProfile_ = "draft";
+    // random_chop segments actually used, by op index, for the draft timeline
+    std::mutex timelineMutex_;
+    std::unordered_map<size_t, std::vector<std::pair<double,double>>> chopSegments_;
+    std::unique_ptr<OperationCache> cache_;
+    util::ThreadPool *pool_ = nullptr; // operation scheduler while runOperations is active
+    ResourceCoordinator *coordinator_ = nullptr;
+    MediaManager *media_ = nullptr;
+    bool lazyNormalize_ = false;
+    int normalizeWidth_ = 1280;
+    int normalizeHeight_ = 720;
+    double normalizeFps_ = 30.0;
+    // Per-input facts for job admission, probed once per path
+    struct InputInfo {
+        double duration = 0.0;
+        int width = 0;
+        int height = 0;
+        std::string codec;
+    };
+    std::mutex inputInfoMutex_;
+    std::unordered_map<std::string, InputInfo> inputInfo_;
+
+    // outputSeconds: the output's duration when the caller knows it (e.g. a stutter's repeats)
+    int runCommand(const std::string &cmd, bool dryRun, double outputSeconds = 0.0);
+
+    // What a command costs for the coordinator: seconds of media it processes (outputSeconds when
+    // known, else its -t value, else the duration of its first input) and the frame sizes / codec
+    // of its inputs
+    void describeCommand(const std::string &cmd, double outputSeconds, double &mediaSeconds, JobShape &shape);
+    InputInfo inputInfo(const std::string &path);
+
+    // Per-op temp file in workdir_ so concurrently running ops never share a path
+    std::string tempPath(size_t opIndex, const std::string &name) const;
+
+    // Draft mode: the rules' operations with proxy inputs and "_draft" outputs; sets proxied to
+    // the number of inputs replaced by a proxy
+    nlohmann::json draftOperations(const nlohmann::json &ops, const std::string &workdir, size_t &proxied) const;
+
+    // The rules with every random_chop's segments filled in, written next to the draft outputs
+    bool writeTimeline(nlohmann::json rules, const std::string &jsonPath, const std::string &workdir, const std::string &draftProfile);
+
+    // Resolve inputs/outputs of every op and derive the dependency edges
+    std::vector<Operation> buildOperations(const nlohmann::json &ops, const std::string &workdir);
+
+    // Fuse linear chains of pitch/bleep/overlay ops, where each intermediate output is only read
+    // by the next op, into one "fused" op producing the chain's final output; returns the number
+    // of ops absorbed
+    size_t fuseChains(std::vector<Operation> &ops);
+
+    // Lazy normalization: append one "normalize" op per asset whose normalized copy an op reads
+    // and make those ops depend on it; returns the number of steps added
+    size_t addNormalizeSteps(std::vector<Operation> &ops);
+
+    // Normalized copy path (pathKey) -> asset, for every asset normalizeAll would normalize
+    std::unordered_map<std::string, std::string> normalizedCopies() const;
+
+    // Pick each op's encoding profile: its own `profile`, else the intermediate profile when a
+    // later op reads the output (and it has no "keep"), else the delivery profile. Final outputs
+    // reading an intermediate re-encode instead of stream-copying. Returns the intermediate count.
+    size_t assignProfiles(std::vector<Operation> &ops, const std::string &deliveryName, const std::string &intermediateName);
+
+    // Where a segmented op's playlist goes: <output stem>_hls/index.m3u8 next to the output
+    static std::string playlistFor(const std::string &output);
+
+    // Let pitch/bleep/overlay/fused/preview ops whose main input is a segmented op's output
+    // start on its first segment; returns the number of such edges
+    size_t linkStreams(std::vector<Operation> &ops);
+
+    // Run ops concurrently on `workers` threads honouring deps; returns first failing rc
+    int runOperations(std::vector<Operation> &ops, int workers, bool dryRun);
+
+    int executeOperation(const Operation &op, bool dryRun);
+
+    // executeOperation behind the result cache; fromCache is set when the output was restored
+    int runCachedOperation(const Operation &op, bool dryRun, bool &fromCache);
+
+    // ffprobe the input for container duration and audio presence; false if probing failed
+    bool probeInput(const std::string &input, double &duration, bool &hasAudio);
 
-    int runCommand(const std::string &cmd, bool dryRun);
+    int processStutter(const std::string &input, double start, double duration, int repeats, bool inPlace, const std::string &output, const EncodingProfile &profile, bool dryRun);
+    int processOverlay(const std::string &input, const std::string &overlay, double start, double end, double scale, const std::string &position, const std::string &output, const EncodingProfile &profile, bool dryRun);
+    int processPitch(const std::string &input, double semitones, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun);
+    int processRandomChop(size_t opIndex, const std::string &input, int count, double min_len, double max_len, bool shuffle, long long seed, std::vector<std::pair<double,double>> segs, int workers, const std::string &mode, int filtergraphThreshold, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun);
+    int processConcat(size_t opIndex, const std::vector<std::string> &inputs, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun);
 
-    int processStutter(const std::string &input, double start, double duration, int repeats, const std::string &output, bool dryRun);
-    int processOverlay(const std::string &input, const std::string &overlay, double start, double end, double scale, const std::string &position, const std::string &output, bool dryRun);
-    int processPitch(const std::string &input, double semitones, const std::string &output, bool dryRun);
-    int processRandomChop(const std::string &input, int count, double min_len, double max_len, bool shuffle, const std::string &output, bool dryRun);
-    int processConcat(const std::vector<std::string> &inputs, const std::string &output, bool dryRun);
+    int processFused(const nlohmann::json &spec, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun);
 
     // New: bleep censor using explicit timestamp ranges
-    int processBleep(const std::string &input, const std::vector<std::pair<double,double>> &ranges, const std::string &output, bool dryRun);
+    int processBleep(const std::string &input, const std::vector<std::pair<double,double>> &ranges, const std::string &output, const EncodingProfile &profile, bool reencode, bool dryRun);
 
     // New: preview operation - launch ffplay (uses ffplay sibling of ffmpeg)
     int processPreview(const std::string &file, bool loop, bool dryRun);
-};
\ No newline at end of file
+};
@@ -0,0 +1,249 @@
+#include "ResourceCoordinator.h"
+#include "Trace.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <cctype>
+#include <memory>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Start offset of the last argument of a builder command line (same quoting rules as
+// util::splitCommandLine: whitespace separates, double quotes group, \" is literal)
+size_t lastArgStart(const std::string &cmd) {
+    size_t last = std::string::npos;
+    bool inToken = false;
+    bool inQuotes = false;
+    for (size_t i = 0; i < cmd.size(); ++i) {
+        char c = cmd[i];
+        if (inQuotes) {
+            if (c == '\\' && i + 1 < cmd.size() && cmd[i + 1] == '"') ++i;
+            else if (c == '"') inQuotes = false;
+            continue;
+        }
+        if (c == ' ' || c == '\t') {
+            inToken = false;
+            continue;
+        }
+        if (!inToken) {
+            inToken = true;
+            last = i;
+        }
+        if (c == '"') inQuotes = true;
+    }
+    return last;
+}
+
+// End offset of the first argument (the executable)
+size_t firstArgEnd(const std::string &cmd) {
+    bool inQuotes = false;
+    bool started = false;
+    for (size_t i = 0; i < cmd.size(); ++i) {
+        char c = cmd[i];
+        if (inQuotes) {
+            if (c == '\\' && i + 1 < cmd.size() && cmd[i + 1] == '"') ++i;
+            else if (c == '"') inQuotes = false;
+            continue;
+        }
+        if (c == ' ' || c == '\t') {
+            if (started) return i;
+            continue;
+        }
+        started = true;
+        if (c == '"') inQuotes = true;
+    }
+    return cmd.size();
+}
+
+double physicalMemoryMb() {
+#ifdef _WIN32
+    MEMORYSTATUSEX ms;
+    ms.dwLength = sizeof(ms);
+    if (GlobalMemoryStatusEx(&ms)) return (double)ms.ullTotalPhys / (1024.0 * 1024.0);
+#elif defined(_SC_PHYS_PAGES)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0) return (double)pages * (double)pageSize / (1024.0 * 1024.0);
+#endif
+    return 8192.0;
+}
+
+} // namespace
+
+ResourceCoordinator::ResourceCoordinator(int threadBudget, int maxJobs, bool adaptive, double memoryLimitMb)
+    : adaptive_(adaptive), memoryLimitMb_(memoryLimitMb > 0.0 ? memoryLimitMb : physicalMemoryMb() * 0.75) {
+    if (threadBudget <= 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threadBudget = (int)std::max(1u, cores);
+    }
+    budget_ = threadBudget;
+    maxJobs_ = maxJobs > 0 ? maxJobs : budget_;
+    // ~4 threads per libx264 encode is a good starting point; adaptation moves from there
+    limit_ = std::max(1, std::min(maxJobs_, budget_ / 4));
+    windowStart_ = std::chrono::steady_clock::now();
+}
+
+int ResourceCoordinator::jobLimit() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return limit_;
+}
+
+double ResourceCoordinator::estimateMemoryMb(const JobShape &shape, int threads) {
+    double w = shape.width > 0 ? shape.width : 1920;
+    double h = shape.height > 0 ? shape.height : 1080;
+    double frameMb = w * h * 1.5 / (1024.0 * 1024.0); // one yuv420p frame
+    std::string codec = shape.codec;
+    for (auto &c : codec) c = (char)std::tolower((unsigned char)c);
+    double decodeFactor = (codec == "hevc" || codec == "vp9" || codec == "av1" || codec == "prores") ? 1.5 : 1.0;
+    threads = std::max(1, threads);
+    // frame-threaded decoders keep a few frames per thread; libx264 veryfast holds its
+    // lookahead and references plus frames in flight per thread
+    double decodeFrames = (8.0 + threads) * decodeFactor * std::max(1, shape.videoInputs);
+    double encodeFrames = 16.0 + 2.0 * threads;
+    return 80.0 + frameMb * (decodeFrames + encodeFrames);
+}
+
+double ResourceCoordinator::projectedMbLocked() {
+    double total = 0.0;
+    for (auto &j : jobs_) {
+        double live = j.pid > 0 ? util::processResidentKb(j.pid) / 1024.0 : 0.0;
+        j.peakMb = std::max(j.peakMb, live);
+        total += std::max(j.estimateMb, live);
+    }
+    return total;
+}
+
+int ResourceCoordinator::acquire(const JobShape &shape, long &id) {
+    std::unique_lock<std::mutex> lk(mtx_);
+    bool announced = false;
+    while (true) {
+        if (active_ < limit_) {
+            int threads = std::max(1, budget_ / limit_);
+            double raw = estimateMemoryMb(shape, threads);
+            double estimate = raw * calibration_;
+            double projected = projectedMbLocked();
+            // a lone job is always admitted, however large, so nothing can starve
+            if (active_ == 0 || projected + estimate <= memoryLimitMb_) {
+                ++active_;
+                id = nextId_++;
+                jobs_.push_back(Job{ id, raw, estimate });
+                return threads;
+            }
+            if (!announced) {
+                std::cout << "[coord] holding a ~" << (long)estimate << " MB job: " << (long)projected << " MB projected of "
+                          << (long)memoryLimitMb_ << " MB" << std::endl;
+                announced = true;
+            }
+            // running children's RSS changes without a release; look again shortly
+            cv_.wait_for(lk, std::chrono::milliseconds(200));
+        } else {
+            cv_.wait(lk);
+        }
+    }
+}
+
+void ResourceCoordinator::attach(long id, long pid) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto &j : jobs_) if (j.id == id) j.pid = pid;
+}
+
+void ResourceCoordinator::detach(long id, long maxRssKb) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (auto &j : jobs_) {
+        if (j.id != id) continue;
+        j.pid = 0;
+        double peak = std::max(j.peakMb, maxRssKb / 1024.0);
+        // learn how far off the model is on this machine and these sources
+        if (peak > 0.0 && j.rawEstimateMb > 0.0) {
+            double ratio = std::max(0.25, std::min(4.0, peak / j.rawEstimateMb));
+            calibration_ = 0.7 * calibration_ + 0.3 * ratio;
+        }
+    }
+}
+
+void ResourceCoordinator::release(long id, double mediaSeconds, double wallSeconds, bool counted) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        --active_;
+        jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(), [id](const Job &j) { return j.id == id; }), jobs_.end());
+        if (counted && mediaSeconds > 0.0 && wallSeconds > 0.0) {
+            windowMedia_ += mediaSeconds;
+            ++windowJobs_;
+            adaptLocked();
+        }
+    }
+    cv_.notify_all();
+}
+
+void ResourceCoordinator::adaptLocked() {
+    if (!adaptive_) return;
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - windowStart_).count();
+    // a window spans at least one job per slot so every slot contributes to the sample
+    if (windowJobs_ < std::max(2, limit_) || elapsed < 1.0) return;
+
+    double throughput = windowMedia_ / elapsed;
+    // keep climbing while throughput improves, turn around once it drops
+    if (lastThroughput_ > 0.0 && throughput < lastThroughput_ * 0.95) direction_ = -direction_;
+    int next = limit_ + direction_;
+    if (next < 1 || next > maxJobs_) {
+        direction_ = -direction_;
+        next = std::max(1, std::min(maxJobs_, limit_ + direction_));
+    }
+    if (next != limit_) {
+        std::cout << "[coord] " << throughput << " media-s/s with " << limit_ << " jobs; now " << next
+                  << " jobs x " << std::max(1, budget_ / next) << " threads" << std::endl;
+    }
+    limit_ = next;
+    lastThroughput_ = throughput;
+    windowStart_ = now;
+    windowMedia_ = 0.0;
+    windowJobs_ = 0;
+}
+
+ResourceCoordinator::Lease::Lease(ResourceCoordinator *coordinator, double mediaSeconds, const JobShape &shape)
+    : coordinator_(coordinator), mediaSeconds_(mediaSeconds) {
+    if (coordinator_) threads_ = coordinator_->acquire(shape, id_);
+    start_ = std::chrono::steady_clock::now();
+}
+
+ResourceCoordinator::Lease::~Lease() {
+    if (!coordinator_) return;
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    coordinator_->release(id_, mediaSeconds_, wall, counted_);
+}
+
+util::ProcessResult ResourceCoordinator::Lease::run(const std::vector<std::string> &argv, const util::ProcessOptions &opts) {
+    std::vector<std::string> args = argv;
+    util::ProcessOptions options = opts;
+    Trace::instrument(args, options);
+    std::unique_ptr<util::Process> p = util::Process::spawn(args, options);
+    if (coordinator_) coordinator_->attach(id_, p->pid());
+    util::ProcessResult r = p->wait();
+    if (coordinator_) coordinator_->detach(id_, r.maxRssKb);
+    if (Trace::enabled()) {
+        Trace::recordChild(args.empty() ? "ffmpeg" : "ffmpeg -> " + fs::path(args.back()).filename().string(), args, r);
+        // the progress report was ours, not the caller's
+        if (!opts.captureStdout) r.out.clear();
+    }
+    return r;
+}
+
+std::string ResourceCoordinator::Lease::apply(const std::string &cmd) const {
+    if (threads_ <= 0) return cmd;
+    size_t out = lastArgStart(cmd);
+    size_t exe = firstArgEnd(cmd);
+    if (out == std::string::npos || out <= exe) return cmd;
+    std::string n = std::to_string(threads_);
+    return cmd.substr(0, exe) + " -filter_threads " + n + cmd.substr(exe, out - exe) + "-threads " + n + " " + cmd.substr(out);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include "Process.h"
+
+// What a job decodes and encodes, for its memory estimate
+struct JobShape {
+    int width = 0;     // largest frame size involved (0 -> assume 1920x1080)
+    int height = 0;
+    int videoInputs = 1;
+    std::string codec; // source video codec; hevc/vp9/av1/prores decoders hold more memory
+};
+
+// Machine-wide budget for ffmpeg children, shared by normalization and rule operations.
+// Each admitted child gets an equal share of the CPU thread budget; the number of children
+// allowed at once is tuned at runtime by hill-climbing on completed media seconds per wall
+// second. A child is only admitted while the projected memory of everything running plus
+// its own estimate stays under the memory limit.
+class ResourceCoordinator {
+public:
+    // threadBudget: CPU threads all children may use together (0 -> all cores)
+    // maxJobs: most children at once (0 -> threadBudget)
+    // adaptive: tune the concurrency limit from measured throughput; otherwise it stays at
+    // its starting value of max(1, threadBudget/4) capped by maxJobs
+    // memoryLimitMb: memory all children may use together (0 -> 75% of physical memory)
+    explicit ResourceCoordinator(int threadBudget = 0, int maxJobs = 0, bool adaptive = true, double memoryLimitMb = 0.0);
+
+    // One admitted ffmpeg child. Construction blocks until the coordinator has room; the
+    // destructor reports the job's media seconds and wall time back. A null coordinator
+    // admits immediately and leaves commands unchanged.
+    class Lease {
+    public:
+        Lease(ResourceCoordinator *coordinator, double mediaSeconds, const JobShape &shape = JobShape());
+        ~Lease();
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        // ffmpeg threads allotted to this job (0 -> unmanaged)
+        int threads() const { return threads_; }
+
+        // cmd with the allotment applied: "-filter_threads N" after the executable and
+        // "-threads N" (encoder threads) before the final output argument
+        std::string apply(const std::string &cmd) const;
+
+        // Spawn and wait for the child; while it runs its live RSS counts toward admission,
+        // and its peak RSS calibrates later estimates
+        util::ProcessResult run(const std::vector<std::string> &argv, const util::ProcessOptions &opts = util::ProcessOptions());
+
+        // Exclude this job from throughput measurement (e.g. it failed early)
+        void discard() { counted_ = false; }
+
+    private:
+        ResourceCoordinator *coordinator_;
+        double mediaSeconds_;
+        int threads_ = 0;
+        long id_ = 0;
+        bool counted_ = true;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Rough peak memory of one ffmpeg child: decoder and encoder frame queues grow with the
+    // frame size and the thread count, plus a fixed base
+    static double estimateMemoryMb(const JobShape &shape, int threads);
+
+    int threadBudget() const { return budget_; }
+    int maxJobs() const { return maxJobs_; }
+    // current concurrency limit
+    int jobLimit();
+    double memoryLimitMb() const { return memoryLimitMb_; }
+
+private:
+    struct Job {
+        long id;
+        double rawEstimateMb; // estimateMemoryMb() at admission
+        double estimateMb;    // the same, calibrated
+        long pid = 0;      // running child, sampled for live RSS
+        double peakMb = 0.0;
+    };
+
+    int acquire(const JobShape &shape, long &id);
+    void release(long id, double mediaSeconds, double wallSeconds, bool counted);
+    void attach(long id, long pid);
+    void detach(long id, long maxRssKb);
+    // Memory of all running jobs: the larger of estimate and live RSS for each (mtx_ held)
+    double projectedMbLocked();
+    // One hill-climbing step once the current measurement window is complete (mtx_ held)
+    void adaptLocked();
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    int budget_;
+    int maxJobs_;
+    bool adaptive_;
+    int limit_;
+    int active_ = 0;
+    int direction_ = 1;
+    double memoryLimitMb_;
+    std::vector<Job> jobs_;
+    long nextId_ = 1;
+    double calibration_ = 1.0; // observed / estimated peak memory, smoothed
+
+    // measurement window: media seconds finished since windowStart_
+    std::chrono::steady_clock::time_point windowStart_;
+    double windowMedia_ = 0.0;
+    int windowJobs_ = 0;
+    double lastThroughput_ = 0.0;
+};
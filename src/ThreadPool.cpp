@@ -0,0 +1,274 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <thread>
+
+namespace util {
+
+namespace {
+
+struct PoolTask {
+    std::function<void()> fn;
+    int priority = 0;
+    uint64_t seq = 0;
+};
+
+// max-heap on priority, FIFO among equal priorities
+bool runsLater(const PoolTask &a, const PoolTask &b) {
+    if (a.priority != b.priority) return a.priority < b.priority;
+    return a.seq > b.seq;
+}
+
+struct WorkerQueue {
+    std::mutex mtx;
+    std::deque<PoolTask> tasks;
+};
+
+} // namespace
+
+struct ThreadPool::Impl {
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // one per worker
+    std::vector<PoolTask> shared;                         // heap ordered by runsLater
+    std::mutex sharedMtx;
+    std::vector<std::thread> workers;
+
+    // queued counts tasks sitting in any queue, running the ones executing; both only reach
+    // zero together under sleepMtx, which is what waitAll() waits for
+    std::mutex sleepMtx;
+    std::condition_variable sleepCv;
+    std::condition_variable idleCv;
+    std::atomic<long> queued{0};
+    std::atomic<long> running{0};
+    std::atomic<uint64_t> seq{0};
+    bool stop = false;
+
+    std::mutex errorMtx;
+    std::exception_ptr firstError;
+
+    static thread_local Impl *tlPool;
+    static thread_local size_t tlWorker;
+
+    explicit Impl(size_t n) {
+        for (size_t i = 0; i < n; ++i) queues.emplace_back(new WorkerQueue());
+        for (size_t i = 0; i < n; ++i) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> lk(sleepMtx);
+            stop = true;
+        }
+        sleepCv.notify_all();
+        for (auto &t : workers) if (t.joinable()) t.join();
+    }
+
+    void push(std::function<void()> fn, int priority) {
+        PoolTask t{ std::move(fn), priority, seq++ };
+        {
+            std::lock_guard<std::mutex> lk(sleepMtx);
+            ++queued;
+        }
+        if (tlPool == this && priority == 0) {
+            WorkerQueue &q = *queues[tlWorker];
+            std::lock_guard<std::mutex> lk(q.mtx);
+            q.tasks.push_back(std::move(t));
+        } else {
+            std::lock_guard<std::mutex> lk(sharedMtx);
+            shared.push_back(std::move(t));
+            std::push_heap(shared.begin(), shared.end(), runsLater);
+        }
+        sleepCv.notify_one();
+    }
+
+    // Own deque (newest first), then the shared queue, then steal the oldest task of another worker
+    bool pop(size_t self, PoolTask &out) {
+        {
+            WorkerQueue &q = *queues[self];
+            std::lock_guard<std::mutex> lk(q.mtx);
+            if (!q.tasks.empty()) {
+                out = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lk(sharedMtx);
+            if (!shared.empty()) {
+                std::pop_heap(shared.begin(), shared.end(), runsLater);
+                out = std::move(shared.back());
+                shared.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k <= queues.size(); ++k) {
+            WorkerQueue &q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lk(q.mtx);
+            if (!q.tasks.empty()) {
+                out = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(PoolTask &t) {
+        ++running;
+        --queued;
+        try {
+            t.fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(errorMtx);
+            if (!firstError) firstError = std::current_exception();
+        }
+        t.fn = nullptr; // release captures before reporting completion
+        {
+            std::lock_guard<std::mutex> lk(sleepMtx);
+            --running;
+        }
+        idleCv.notify_all();
+    }
+
+    void workerLoop(size_t self) {
+        tlPool = this;
+        tlWorker = self;
+        while (true) {
+            PoolTask t;
+            if (pop(self, t)) {
+                execute(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lk(sleepMtx);
+            if (stop && queued.load() == 0) return;
+            sleepCv.wait(lk, [this]() { return stop || queued.load() > 0; });
+            if (stop && queued.load() == 0) return;
+        }
+    }
+};
+
+thread_local ThreadPool::Impl *ThreadPool::Impl::tlPool = nullptr;
+thread_local size_t ThreadPool::Impl::tlWorker = 0;
+
+ThreadPool::ThreadPool(size_t workerCount) {
+    if (workerCount == 0) workerCount = 1;
+    impl_ = new Impl(workerCount);
+}
+
+ThreadPool::~ThreadPool() {
+    delete impl_;
+}
+
+size_t ThreadPool::workerCount() const {
+    return impl_->workers.size();
+}
+
+bool ThreadPool::inWorker() const {
+    return Impl::tlPool == impl_;
+}
+
+void ThreadPool::enqueue(std::function<void()> job, int priority) {
+    impl_->push(std::move(job), priority);
+}
+
+void ThreadPool::waitAll() {
+    {
+        std::unique_lock<std::mutex> lk(impl_->sleepMtx);
+        impl_->idleCv.wait(lk, [this]() { return impl_->queued.load() == 0 && impl_->running.load() == 0; });
+    }
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lk(impl_->errorMtx);
+        std::swap(error, impl_->firstError);
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+// A group task is started exactly once: by a pool worker or by a thread helping in wait(),
+// whichever claims it first.
+struct TaskGroup::Task {
+    std::function<void()> fn;
+    std::atomic<bool> claimed{false};
+};
+
+struct TaskGroup::State {
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t pending = 0;
+    std::vector<std::shared_ptr<Task>> unstarted; // may hold claimed tasks until pruned
+    std::exception_ptr firstError;
+};
+
+TaskGroup::TaskGroup(ThreadPool &pool, CancellationToken token)
+    : pool_(pool), token_(std::move(token)), state_(std::make_shared<State>()) {}
+
+TaskGroup::~TaskGroup() {
+    try { wait(); } catch (...) {}
+}
+
+void TaskGroup::run(std::function<void()> job, int priority) {
+    auto task = std::make_shared<Task>();
+    task->fn = std::move(job);
+    {
+        std::lock_guard<std::mutex> lk(state_->mtx);
+        ++state_->pending;
+        state_->unstarted.push_back(task);
+    }
+    state_->cv.notify_all(); // a helping waiter may pick it up
+    std::shared_ptr<State> state = state_;
+    CancellationToken token = token_;
+    pool_.enqueue([state, task, token]() { runTask(state, task, token); }, priority);
+}
+
+void TaskGroup::wait() {
+    // an outside thread just blocks; only a worker helps, keeping the pool's concurrency bound
+    bool help = pool_.inWorker();
+    std::unique_lock<std::mutex> lk(state_->mtx);
+    while (state_->pending > 0) {
+        // help: run one of our own tasks that no worker has started yet
+        std::shared_ptr<Task> mine;
+        auto &list = state_->unstarted;
+        list.erase(std::remove_if(list.begin(), list.end(), [](const std::shared_ptr<Task> &t) { return t->claimed.load(); }), list.end());
+        if (help && !list.empty()) {
+            mine = list.back();
+            list.pop_back();
+        }
+        if (mine) {
+            lk.unlock();
+            runTask(state_, mine, token_);
+            lk.lock();
+            continue;
+        }
+        state_->cv.wait(lk, [this, help]() {
+            if (state_->pending == 0) return true;
+            if (help) for (auto &t : state_->unstarted) if (!t->claimed.load()) return true;
+            return false;
+        });
+    }
+    std::exception_ptr error;
+    std::swap(error, state_->firstError);
+    lk.unlock();
+    if (error) std::rethrow_exception(error);
+}
+
+void TaskGroup::runTask(const std::shared_ptr<State> &state, const std::shared_ptr<Task> &task, const CancellationToken &token) {
+    if (task->claimed.exchange(true)) return; // already run by the other side
+    if (!token.cancelled()) {
+        try {
+            task->fn();
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(state->mtx);
+            if (!state->firstError) state->firstError = std::current_exception();
+        }
+    }
+    task->fn = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(state->mtx);
+        --state->pending;
+    }
+    state->cv.notify_all();
+}
+
+} // namespace util
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace util {
+
+// Cooperative cancellation flag shared by copies of the token. Cancelling is sticky;
+// running tasks poll cancelled(), tasks that have not started are skipped.
+class CancellationToken {
+public:
+    CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+    void cancel() const { flag_->store(true); }
+    bool cancelled() const { return flag_->load(); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// Work-stealing task scheduler. Every worker owns a deque: tasks queued from inside a task
+// go to the running worker's deque (LIFO for the owner, stolen FIFO by idle workers), tasks
+// queued from outside or with a non-zero priority go to a shared queue where higher
+// priorities run first and equal priorities run in submission order.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workerCount = 1);
+    // Runs every queued task, then joins the workers
+    ~ThreadPool();
+
+    size_t workerCount() const;
+
+    // True when called from one of this pool's worker threads
+    bool inWorker() const;
+
+    // Enqueue a job (callable<void()>). An exception escaping the job is rethrown by waitAll().
+    void enqueue(std::function<void()> job, int priority = 0);
+
+    // Enqueue a job and get its result (or exception) through a future
+    template <class F>
+    auto submit(F job, int priority = 0) -> std::future<decltype(job())> {
+        using R = decltype(job());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(job));
+        std::future<R> result = task->get_future();
+        enqueue([task]() { (*task)(); }, priority);
+        return result;
+    }
+
+    // Wait until all jobs finished (simple barrier); rethrows the first exception of an
+    // enqueue()d job. Must not be called from inside a task of this pool.
+    void waitAll();
+
+private:
+    struct Impl;
+    Impl *impl_;
+};
+
+// A set of tasks on a pool that can be awaited (and cancelled) on its own. Waiting from a
+// worker of the pool runs the group's not-yet-started tasks on that worker, so a task may wait
+// for a group it created without tying up a worker or deadlocking a saturated pool.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool &pool, CancellationToken token = CancellationToken());
+    // Waits for the group's tasks; exceptions are dropped here, call wait() to see them
+    ~TaskGroup();
+
+    // Queue a job; it is skipped if the group is cancelled before it starts
+    void run(std::function<void()> job, int priority = 0);
+
+    // Block until every job of the group finished or was skipped; rethrows the first exception
+    void wait();
+
+    void cancel() { token_.cancel(); }
+    bool cancelled() const { return token_.cancelled(); }
+    const CancellationToken &token() const { return token_; }
+
+private:
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    struct State;
+    struct Task;
+    static void runTask(const std::shared_ptr<State> &state, const std::shared_ptr<Task> &task, const CancellationToken &token);
+
+    ThreadPool &pool_;
+    CancellationToken token_;
+    std::shared_ptr<State> state_;
+};
+
+} // namespace util
@@ -0,0 +1,244 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Event {
+    std::string category;
+    std::string name;
+    double startUs = 0.0;
+    double durUs = 0.0;
+    int tid = 0;
+    json args;
+};
+
+struct ChildRecord {
+    std::string label;
+    double wall = 0.0;
+    double user = 0.0;
+    double sys = 0.0;
+    long maxRssKb = 0;
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+    double fps = 0.0;
+    double speed = 0.0;
+    int exitCode = 0;
+};
+
+std::atomic<bool> gEnabled{false};
+std::mutex gMutex;
+Clock::time_point gOrigin;
+std::vector<Event> gEvents;
+std::vector<ChildRecord> gChildren;
+std::map<std::thread::id, int> gThreadIds;
+
+double sinceOriginUs(Clock::time_point t) {
+    return std::chrono::duration<double, std::micro>(t - gOrigin).count();
+}
+
+// small stable thread numbers for the trace viewer (gMutex held)
+int threadIdLocked() {
+    auto it = gThreadIds.find(std::this_thread::get_id());
+    if (it != gThreadIds.end()) return it->second;
+    int id = (int)gThreadIds.size() + 1;
+    gThreadIds[std::this_thread::get_id()] = id;
+    return id;
+}
+
+// Last value of key=... in ffmpeg -progress output ("speed=1.5x", "fps=87.2")
+double lastProgressValue(const std::string &out, const std::string &key) {
+    std::string needle = key + "=";
+    size_t pos = out.rfind("\n" + needle);
+    if (pos == std::string::npos) {
+        if (out.compare(0, needle.size(), needle) != 0) return 0.0;
+        pos = 0;
+    } else {
+        ++pos;
+    }
+    try {
+        return std::stod(out.substr(pos + needle.size()));
+    } catch (...) {
+        return 0.0;
+    }
+}
+
+std::string megabytes(double bytes) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0);
+    return ss.str();
+}
+
+} // namespace
+
+void Trace::enable() {
+    std::lock_guard<std::mutex> lk(gMutex);
+    if (gEnabled) return;
+    gOrigin = Clock::now();
+    gEnabled = true;
+}
+
+bool Trace::enabled() {
+    return gEnabled.load();
+}
+
+Trace::Span::Span(const std::string &category, const std::string &name)
+    : active_(Trace::enabled()) {
+    if (!active_) return;
+    category_ = category;
+    name_ = name;
+    start_ = Clock::now();
+}
+
+Trace::Span::~Span() {
+    if (!active_) return;
+    Clock::time_point end = Clock::now();
+    std::lock_guard<std::mutex> lk(gMutex);
+    Event e;
+    e.category = category_;
+    e.name = name_;
+    e.startUs = sinceOriginUs(start_);
+    e.durUs = std::chrono::duration<double, std::micro>(end - start_).count();
+    e.tid = threadIdLocked();
+    e.args = std::move(args_);
+    gEvents.push_back(std::move(e));
+}
+
+void Trace::Span::arg(const std::string &key, const json &value) {
+    if (active_) args_[key] = value;
+}
+
+void Trace::instrument(std::vector<std::string> &argv, util::ProcessOptions &opts) {
+    // a caller that reads stdout itself keeps it to itself
+    if (!enabled() || argv.empty() || opts.captureStdout) return;
+    std::string tool = fs::path(argv[0]).stem().string();
+    if (tool != "ffmpeg") return;
+    // progress goes to stdout; media goes to the output file, so the pipe is free
+    argv.insert(argv.begin() + 1, { "-progress", "pipe:1" });
+    opts.captureStdout = true;
+}
+
+void Trace::recordChild(const std::string &label, const std::vector<std::string> &argv, const util::ProcessResult &result) {
+    if (!enabled()) return;
+    ChildRecord c;
+    c.label = label;
+    c.wall = result.wallSeconds;
+    c.user = result.userSeconds;
+    c.sys = result.systemSeconds;
+    c.maxRssKb = result.maxRssKb;
+    c.readBytes = result.readBytes;
+    c.writeBytes = result.writeBytes;
+    c.fps = lastProgressValue(result.out, "fps");
+    c.speed = lastProgressValue(result.out, "speed");
+    c.exitCode = result.exitCode;
+
+    Clock::time_point end = Clock::now();
+    Event e;
+    e.category = "process";
+    e.name = label;
+    e.durUs = result.wallSeconds * 1e6;
+    e.startUs = sinceOriginUs(end) - e.durUs;
+    e.args = {
+        { "argv", argv }, { "exit_code", c.exitCode }, { "user_s", c.user }, { "sys_s", c.sys },
+        { "max_rss_kb", c.maxRssKb }, { "read_bytes", c.readBytes }, { "write_bytes", c.writeBytes }
+    };
+    if (c.fps > 0.0) e.args["fps"] = c.fps;
+    if (c.speed > 0.0) e.args["speed"] = c.speed;
+
+    std::lock_guard<std::mutex> lk(gMutex);
+    e.tid = threadIdLocked();
+    gEvents.push_back(std::move(e));
+    gChildren.push_back(std::move(c));
+}
+
+Trace::Totals Trace::totals() {
+    Totals t;
+    std::lock_guard<std::mutex> lk(gMutex);
+    for (auto &c : gChildren) {
+        ++t.children;
+        t.wallSeconds += c.wall;
+        t.userSeconds += c.user;
+        t.systemSeconds += c.sys;
+        t.peakRssKb = std::max(t.peakRssKb, c.maxRssKb);
+        t.readBytes += c.readBytes;
+        t.writeBytes += c.writeBytes;
+    }
+    return t;
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> lk(gMutex);
+    gEvents.clear();
+    gChildren.clear();
+}
+
+bool Trace::writeChromeTrace(const std::string &path) {
+    json j;
+    j["displayTimeUnit"] = "ms";
+    json &events = j["traceEvents"] = json::array();
+    {
+        std::lock_guard<std::mutex> lk(gMutex);
+        for (auto &t : gThreadIds) {
+            events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", t.second },
+                               { "args", { { "name", t.second == 1 ? "main" : "worker " + std::to_string(t.second) } } } });
+        }
+        for (auto &e : gEvents) {
+            json ev = { { "name", e.name }, { "cat", e.category }, { "ph", "X" }, { "pid", 1 }, { "tid", e.tid },
+                        { "ts", e.startUs }, { "dur", e.durUs } };
+            if (!e.args.is_null()) ev["args"] = e.args;
+            events.push_back(std::move(ev));
+        }
+    }
+    std::ofstream ofs(path);
+    if (!ofs) return false;
+    ofs << j.dump();
+    return (bool)ofs;
+}
+
+void Trace::printSummary(std::ostream &os) {
+    std::vector<Event> spans;
+    std::vector<ChildRecord> children;
+    {
+        std::lock_guard<std::mutex> lk(gMutex);
+        for (auto &e : gEvents) if (e.category != "process") spans.push_back(e);
+        children = gChildren;
+    }
+
+    os << "Trace summary\n";
+    std::sort(spans.begin(), spans.end(), [](const Event &a, const Event &b) { return a.durUs > b.durUs; });
+    os << "  slowest spans:\n";
+    for (size_t i = 0; i < spans.size() && i < 15; ++i) {
+        os << "    " << std::setw(10) << spans[i].category << "  " << std::fixed << std::setprecision(2) << std::setw(9)
+           << spans[i].durUs / 1e6 << " s  " << spans[i].name << "\n";
+    }
+
+    Totals t = totals();
+    os << "  child processes: " << t.children << ", wall " << std::setprecision(2) << t.wallSeconds << " s, cpu "
+       << t.userSeconds << " s user + " << t.systemSeconds << " s sys, peak RSS " << megabytes(t.peakRssKb * 1024.0)
+       << " MB, read " << megabytes((double)t.readBytes) << " MB, written " << megabytes((double)t.writeBytes) << " MB\n";
+
+    std::sort(children.begin(), children.end(), [](const ChildRecord &a, const ChildRecord &b) { return a.wall > b.wall; });
+    if (!children.empty()) {
+        os << "  slowest children:       wall s    user s     sys s   RSS MB      fps   speed  label\n";
+    }
+    for (size_t i = 0; i < children.size() && i < 10; ++i) {
+        const ChildRecord &c = children[i];
+        os << "                       " << std::setw(9) << c.wall << " " << std::setw(9) << c.user << " " << std::setw(9)
+           << c.sys << " " << std::setw(8) << megabytes(c.maxRssKb * 1024.0) << " " << std::setw(8)
+           << std::setprecision(1) << c.fps << " " << std::setw(6) << c.speed << "x  " << c.label
+           << (c.exitCode != 0 ? " (failed)" : "") << "\n" << std::setprecision(2);
+    }
+    os.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <nlohmann/json.hpp>
+#include "Process.h"
+
+// Run-wide record of operations, normalizations and child processes. Nothing is recorded
+// until Trace::enable() is called, so the hooks cost a flag check in normal runs.
+class Trace {
+public:
+    static void enable();
+    static bool enabled();
+
+    // A timed region on the calling thread; becomes a complete ("X") event in the trace
+    class Span {
+    public:
+        Span(const std::string &category, const std::string &name);
+        ~Span();
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        void arg(const std::string &key, const nlohmann::json &value);
+
+    private:
+        bool active_;
+        std::string category_;
+        std::string name_;
+        nlohmann::json args_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Prepare an ffmpeg child for tracing: adds "-progress pipe:1" and captures stdout so
+    // fps/speed can be read afterwards. No-op when disabled, when argv is not ffmpeg or
+    // when stdout is already captured.
+    static void instrument(std::vector<std::string> &argv, util::ProcessOptions &opts);
+
+    // Record a finished child (wall, CPU, peak RSS, I/O, ffmpeg progress) on the calling thread
+    static void recordChild(const std::string &label, const std::vector<std::string> &argv, const util::ProcessResult &result);
+
+    // Sums over the child processes recorded so far
+    struct Totals {
+        size_t children = 0;
+        double wallSeconds = 0.0;
+        double userSeconds = 0.0;
+        double systemSeconds = 0.0;
+        long peakRssKb = 0; // largest single child
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+    };
+    static Totals totals();
+
+    // Drop everything recorded so far (e.g. between benchmark cases)
+    static void clear();
+
+    // Chrome trace event format (chrome://tracing, Perfetto); false on I/O error
+    static bool writeChromeTrace(const std::string &path);
+
+    // Slowest spans and children plus totals
+    static void printSummary(std::ostream &os);
+};
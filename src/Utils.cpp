@@ -1,18 +1,15 @@
 #include "Utils.h"
+#include "Process.h"
 #include <cstdlib>
 #include <filesystem>
 #include <random>
 #include <sstream>
+#include <iomanip>
+#include <cstdint>
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <mutex>
-#include <condition_variable>
-#include <queue>
-
-#ifdef _WIN32
-#include <windows.h>
-#endif
 
 namespace util {
 
@@ -28,31 +25,25 @@ std::string quote(const std::string &s) {
 
 int runCommand(const std::string &cmd) {
     std::cout << "[cmd] " << cmd << std::endl;
-    return std::system(cmd.c_str());
+    ProcessResult r = runProcess(splitCommandLine(cmd));
+    return r.exitCode;
 }
 
 std::pair<int, std::string> runCapture(const std::string &cmd) {
-#ifdef _WIN32
-    FILE *pipe = _popen(cmd.c_str(), "r");
-    if (!pipe) return { -1, "" };
-    std::string result;
-    char buffer[256];
-    while (fgets(buffer, sizeof(buffer), pipe)) {
-        result += buffer;
-    }
-    int rc = _pclose(pipe);
-    return { rc, result };
-#else
-    FILE *pipe = popen(cmd.c_str(), "r");
-    if (!pipe) return { -1, "" };
-    std::string result;
-    char buffer[256];
-    while (fgets(buffer, sizeof(buffer), pipe)) {
-        result += buffer;
+    ProcessOptions opts;
+    opts.captureStdout = true;
+    ProcessResult r = runProcess(splitCommandLine(cmd), opts);
+    return { r.exitCode, r.out };
+}
+
+std::string toolPath(const std::string &ffmpegPath, const std::string &name) {
+    std::filesystem::path dir = std::filesystem::path(ffmpegPath).parent_path();
+    for (const std::string &candidate : { name + ".exe", name }) {
+        std::filesystem::path p = dir / candidate;
+        std::error_code ec;
+        if (!dir.empty() && std::filesystem::is_regular_file(p, ec)) return p.string();
     }
-    int rc = pclose(pipe);
-    return { rc, result };
-#endif
+    return name;
 }
 
 bool ensureDir(const std::string &path) {
@@ -102,64 +93,15 @@ std::string fileFingerprint(const std::string &path) {
     }
 }
 
-// ThreadPool implementation (very small)
-struct util::ThreadPool::Impl {
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex mtx;
-    std::condition_variable cv;
-    bool stop = false;
-    std::atomic<int> active{0};
-    Impl(size_t n) {
-        for (size_t i = 0; i < n; ++i) {
-            workers.emplace_back([this](){
-                while (true) {
-                    std::function<void()> job;
-                    {
-                        std::unique_lock<std::mutex> lk(mtx);
-                        cv.wait(lk, [this](){ return stop || !tasks.empty(); });
-                        if (stop && tasks.empty()) return;
-                        job = std::move(tasks.front());
-                        tasks.pop();
-                        active++;
-                    }
-                    try { job(); } catch (...) {}
-                    active--;
-                    cv.notify_all();
-                }
-            });
-        }
+std::string hashString(const std::string &data) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ULL;
     }
-    ~Impl() {
-        {
-            std::unique_lock<std::mutex> lk(mtx);
-            stop = true;
-        }
-        cv.notify_all();
-        for (auto &t : workers) if (t.joinable()) t.join();
-    }
-};
-
-util::ThreadPool::ThreadPool(size_t workerCount) {
-    if (workerCount == 0) workerCount = 1;
-    impl_ = new Impl(workerCount);
-}
-
-util::ThreadPool::~ThreadPool() {
-    delete impl_;
-}
-
-void util::ThreadPool::enqueue(std::function<void()> job) {
-    {
-        std::unique_lock<std::mutex> lk(impl_->mtx);
-        impl_->tasks.push(std::move(job));
-    }
-    impl_->cv.notify_one();
-}
-
-void util::ThreadPool::waitAll() {
-    std::unique_lock<std::mutex> lk(impl_->mtx);
-    impl_->cv.wait(lk, [this](){ return impl_->tasks.empty() && impl_->active.load() == 0; });
+    std::ostringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << h;
+    return ss.str();
 }
 
 } // namespace util
\ No newline at end of file
@@ -2,18 +2,23 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include "ThreadPool.h"
 
 namespace util {
 
 // Quote a path for Windows cmd (simple)
 std::string quote(const std::string &s);
 
-// Run a command and return exit code
+// Run a command (split into argv, no shell) and return exit code
 int runCommand(const std::string &cmd);
 
 // Run a command and capture stdout (returns pair<exitcode,stdout>)
 std::pair<int, std::string> runCapture(const std::string &cmd);
 
+// Locate a sibling tool of ffmpeg (e.g. "ffprobe", "ffplay"): <dir>/<name>.exe or
+// <dir>/<name> when present, otherwise the bare name to be found on PATH
+std::string toolPath(const std::string &ffmpegPath, const std::string &name);
+
 // Create directories recursively, return true on success
 bool ensureDir(const std::string &path);
 
@@ -26,21 +31,7 @@ std::vector<int> pickRandomIndices(int n, int want);
 // Produce a fast fingerprint string for a file (size + last_write_time)
 std::string fileFingerprint(const std::string &path);
 
-// Simple thread pool
-class ThreadPool {
-public:
-    explicit ThreadPool(size_t workerCount = 1);
-    ~ThreadPool();
-
-    // Enqueue a job (callable<void()>)
-    void enqueue(std::function<void()> job);
-
-    // Wait until all jobs finished (simple barrier)
-    void waitAll();
-
-private:
-    struct Impl;
-    Impl* impl_;
-};
+// 64-bit FNV-1a of data as 16 hex chars (cache keys, not cryptographic)
+std::string hashString(const std::string &data);
 
 } // namespace util
\ No newline at end of file
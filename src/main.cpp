@@ -1,5 +1,8 @@
 #include "RemixRuleEngine.h"
 #include "MediaManager.h"
+#include "ResourceCoordinator.h"
+#include "Trace.h"
+#include "EncodingProfile.h"
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <fstream>
@@ -9,7 +12,7 @@ using json = nlohmann::json;
 
 int main(int argc, char **argv) {
     std::cout << "Mody+ Deluxe Orchestrator v1.0 (with Source Material Handling + parallel normalization)\n";
-    std::cout << "Usage: modyplus_deluxe <path-to-ffmpeg.exe> <path-to-rules.json> [--dry-run]\n\n";
+    std::cout << "Usage: modyplus_deluxe <path-to-ffmpeg.exe> <path-to-rules.json> [--dry-run] [--no-cache] [--trace] [--draft|--final]\n\n";
 
     if (argc < 3) {
         std::cerr << "Not enough arguments.\n";
@@ -19,9 +22,22 @@ int main(int argc, char **argv) {
     std::string ffmpegPath = argv[1];
     std::string rulesPath = argv[2];
     bool dryRun = false;
-    if (argc >= 4) {
-        std::string opt = argv[3];
+    bool useCache = true;
+    bool trace = false;
+    bool draft = false;
+    bool final = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string opt = argv[i];
         if (opt == "--dry-run") dryRun = true;
+        else if (opt == "--no-cache") useCache = false;
+        else if (opt == "--trace") trace = true;
+        else if (opt == "--draft") draft = true;
+        else if (opt == "--final") final = true;
+        else std::cerr << "Ignoring unknown option: " << opt << std::endl;
+    }
+    if (draft && final) {
+        std::cerr << "--draft and --final are mutually exclusive.\n";
+        return 1;
     }
 
     // Load rules to inspect preprocessing settings
@@ -37,44 +53,148 @@ int main(int argc, char **argv) {
 
     // Create media manager and scan assets
     std::string assetsDir = "assets";
+    int scanWorkers = 0; // 0 -> auto
+    std::string indexFormat = "json";
+    bool exportIndexJson = false;
+    bool keepRawProbes = false;
     if (rules.contains("global") && rules["global"].contains("assets_dir")) {
         assetsDir = rules["global"]["assets_dir"].get<std::string>();
     }
+    if (rules.contains("global") && rules["global"].is_object()) {
+        scanWorkers = rules["global"].value("scan_workers", 0);
+        indexFormat = rules["global"].value("index_format", indexFormat);
+        exportIndexJson = rules["global"].value("export_index_json", false);
+        keepRawProbes = rules["global"].value("keep_raw_probe", false);
+    }
+
+    // Tracing: spans for scan/normalize/operations plus every child process
+    std::string traceFile = "output/trace.json";
+    if (rules.contains("global") && rules["global"].is_object()) {
+        trace = trace || rules["global"].value("trace", false);
+        traceFile = rules["global"].value("trace_file", traceFile);
+    }
+    if (trace) Trace::enable();
+    auto finishTrace = [&]() {
+        if (!trace) return;
+        Trace::printSummary(std::cout);
+        if (Trace::writeChromeTrace(traceFile)) std::cout << "Trace written to " << traceFile << "\n";
+        else std::cerr << "Failed to write trace: " << traceFile << std::endl;
+    };
 
-    MediaManager mm(ffmpegPath, "output");
-    int found = mm.scanAssets(assetsDir);
+    // One CPU budget for every ffmpeg child, normalization and rule operations alike
+    int cpuThreads = 0;
+    int maxJobs = 0;
+    bool adaptiveJobs = true;
+    double memoryLimitMb = 0.0; // 0 -> 75% of physical memory
+    if (rules.contains("global") && rules["global"].is_object()) {
+        cpuThreads = rules["global"].value("cpu_threads", 0);
+        maxJobs = rules["global"].value("max_jobs", 0);
+        adaptiveJobs = rules["global"].value("adaptive_jobs", true);
+        memoryLimitMb = rules["global"].value("memory_limit_mb", 0.0);
+    }
+    ResourceCoordinator coordinator(cpuThreads, maxJobs, adaptiveJobs, memoryLimitMb);
+    std::cout << "CPU budget: " << coordinator.threadBudget() << " threads, up to " << coordinator.maxJobs()
+              << " ffmpeg jobs (starting at " << coordinator.jobLimit() << "), "
+              << (long)coordinator.memoryLimitMb() << " MB memory\n";
+
+    MediaManager mm(ffmpegPath, "output", indexFormat, keepRawProbes);
+    mm.setCoordinator(&coordinator);
+    int found = 0;
+    {
+        Trace::Span span("phase", "scan");
+        found = mm.scanAssets(assetsDir, scanWorkers);
+    }
     std::cout << "MediaManager: scanned " << found << " assets.\n";
 
-    // Preprocessing: normalize_all with parallel workers
+    // Normalized copies are read again by the rules: intermediate profile unless preprocessing.profile says otherwise
+    EncodingProfiles profiles;
+    std::string normalizeProfile = "intermediate";
+    if (rules.contains("global") && rules["global"].is_object()) {
+        if (rules["global"].contains("profiles")) profiles.load(rules["global"]["profiles"]);
+        normalizeProfile = rules["global"].value("intermediate_profile", normalizeProfile);
+    }
     if (rules.contains("preprocessing") && rules["preprocessing"].is_object()) {
+        normalizeProfile = rules["preprocessing"].value("profile", normalizeProfile);
+        // long assets are split into chunks encoded on several workers at once
+        mm.setChunkedNormalize(rules["preprocessing"].value("chunked", true), rules["preprocessing"].value("chunk_min_seconds", 60.0));
+    }
+    mm.setEncodingProfile(profiles.get(normalizeProfile, "intermediate"));
+    if (rules.contains("global") && rules["global"].is_object()) {
+        mm.setSmartCut(rules["global"].value("smart_cut", true), rules["global"].value("smart_cut_min_seconds", 3.0));
+    }
+
+    // Preprocessing: normalize everything up front with parallel workers ("all"), or only the
+    // assets the rules reference, as steps of the operation graph ("lazy")
+    bool lazyNormalize = false;
+    int targetW = 1280;
+    int targetH = 720;
+    double targetFps = 30.0;
+    if (draft) {
+        // Drafts read low-res proxies instead of normalized copies; assets without a proxy fall
+        // back to lazy normalization
+        json pre = rules.contains("preprocessing") && rules["preprocessing"].is_object() ? rules["preprocessing"] : json::object();
+        int proxyW = pre.value("proxy_width", 426);
+        int proxyH = pre.value("proxy_height", 240);
+        double proxyFps = pre.value("proxy_fps", 15.0);
+        std::string proxyProfile = "draft";
+        if (rules.contains("global") && rules["global"].is_object()) proxyProfile = rules["global"].value("draft_profile", proxyProfile);
+        proxyProfile = pre.value("proxy_profile", proxyProfile);
+        mm.setProxyProfile(profiles.get(proxyProfile, "draft"));
+        int workers = pre.value("normalize_workers", 0);
+        if (workers <= 0) workers = coordinator.maxJobs();
+        targetW = pre.value("target_width", 1280);
+        targetH = pre.value("target_height", 720);
+        targetFps = pre.value("target_fps", 30.0);
+        lazyNormalize = true;
+        std::cout << "Draft mode: proxies at " << proxyW << "x" << proxyH << " @" << proxyFps << "fps using " << workers << " workers\n";
+        Trace::Span span("phase", "proxies");
+        int ready = mm.makeProxies(workers, proxyW, proxyH, proxyFps);
+        std::cout << "MediaManager: " << ready << " proxies ready.\n";
+    } else if (rules.contains("preprocessing") && rules["preprocessing"].is_object()) {
         auto pre = rules["preprocessing"];
-        int targetW = pre.value("target_width", 1280);
-        int targetH = pre.value("target_height", 720);
-        double targetFps = pre.value("target_fps", 30.0);
+        targetW = pre.value("target_width", 1280);
+        targetH = pre.value("target_height", 720);
+        targetFps = pre.value("target_fps", 30.0);
         bool normalizeAll = pre.value("normalize_all", true);
+        std::string mode = pre.value("normalize_mode", normalizeAll ? "all" : "none");
         int workers = pre.value("normalize_workers", 0); // 0 -> auto
 
-        if (normalizeAll) {
-            // default worker count heuristic
-            if (workers <= 0) {
-                unsigned int cores = std::thread::hardware_concurrency();
-                if (cores == 0) cores = 2;
-                // be conservative on Windows 8.1: half the cores, at least 1
-                workers = std::max(1u, cores / 2);
-            }
+        if (mode == "lazy") {
+            lazyNormalize = true;
+            std::cout << "Normalizing referenced media to " << targetW << "x" << targetH << " @" << targetFps << "fps on demand\n";
+        } else if (mode == "all") {
+            // auto: enough workers for the coordinator's largest job limit; it decides how many encode at once
+            if (workers <= 0) workers = coordinator.maxJobs();
             std::cout << "Normalizing media to " << targetW << "x" << targetH << " @" << targetFps << "fps using " << workers << " workers\n";
+            Trace::Span span("phase", "normalize");
             mm.normalizeAll(workers, targetW, targetH, targetFps);
         }
     }
 
     // Now run the RemixRuleEngine as before
     RemixRuleEngine engine(ffmpegPath, "output");
-    int r = engine.runFromJson(rulesPath, dryRun);
+    engine.setCacheEnabled(useCache);
+    engine.setCoordinator(&coordinator);
+    engine.setMediaManager(&mm);
+    if (lazyNormalize) engine.setLazyNormalization(targetW, targetH, targetFps);
+    engine.setDraft(draft);
+    engine.setFinal(final);
+    int r = 0;
+    {
+        Trace::Span span("phase", "rules");
+        r = engine.runFromJson(rulesPath, dryRun);
+    }
     if (r != 0) {
         std::cerr << "Processing failed with error: " << r << std::endl;
+        finishTrace();
         return r;
     }
 
+    if (exportIndexJson && indexFormat == "binary") {
+        mm.exportIndexJson("output/media_index.json");
+    }
+
+    finishTrace();
     std::cout << "Processing complete. Check the output/ folder.\n";
     return 0;
 }
\ No newline at end of file